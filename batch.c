@@ -0,0 +1,536 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "qsim.h"
+
+/* extension of experiment files, found in a directory; those of the output of each, as text or binary; and that
+ * of the list of the values of the runs of a sweep */
+#define BA_EXP     ".exp"
+#define BA_TEXT    ".out"
+#define BA_BINARY  ".bin"
+#define BA_RUNS    ".runs"
+
+/* longest name of a file beside an experiment file, with its run and extension */
+#define BA_NAMESIZE  (exp_PATHSIZE + 32)
+
+/* longest line of a list of experiment files */
+#define BA_LINESIZE  (exp_PATHSIZE + 2)
+
+/* batch structure; the experiment files of a batch, and the options that every one of them is run with; or the
+ * experiment whose sweep is run. (n) is the number of experiments or runs. */
+struct batch
+{
+	char **paths;
+	int npaths, size;
+	const struct exp *options;
+	struct exp *base;
+	int n;
+	struct mutexint next;    /* index of the next experiment or run */
+	struct mutexint failed;  /* number of experiments or runs that failed */
+};
+
+/* add: Add the experiment file (name), after (x) characters of (dir), to the batch (B). Returns 0 on failure, and
+ * 1 on success.
+ */
+static int add(struct batch *B, const char *dir, int x, const char *name)
+{
+	char **paths;
+
+	if (x + strlen(name) >= exp_PATHSIZE)
+	{
+		warn(WL_warn, "runbatch", "Experiment file \"%a\" has too long a path, skipping.\n", name);
+
+		return 1;
+	}
+
+	if (B->npaths == B->size)
+	{
+		if ((paths = realloc(B->paths, (B->size ? B->size * 2 : 64) * sizeof(char *))) == NULL)
+		{
+			warn(WL_crash, "runbatch", "realloc returned NULL when attempting allocation of the batch.\n");
+
+			return 0;
+		}
+
+		B->paths = paths;
+		B->size = B->size ? B->size * 2 : 64;
+	}
+
+	if ((B->paths[B->npaths] = malloc(x + strlen(name) + 1)) == NULL)
+	{
+		warn(WL_crash, "runbatch", "malloc returned NULL when attempting allocation of a path.\n");
+
+		return 0;
+	}
+
+	memcpy(B->paths[B->npaths], dir, x);
+	strcpy(B->paths[B->npaths] + x, name);
+	++B->npaths;
+
+	return 1;
+}
+
+/* compare: Compare the paths at (a) and (b), for (qsort). */
+static int compare(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* readbatchdir: Add every experiment file in the directory (path) to the batch (B), in order of their names.
+ * Returns 0 on failure, and 1 on success.
+ */
+static int readbatchdir(const char *path, struct batch *B)
+{
+	struct dirent *entry;
+	struct stat statbuf;
+	char dir[exp_PATHSIZE + 1];
+	DIR *d;
+	int x, n, first = B->npaths;
+
+	if ((x = strlen(path)) >= exp_PATHSIZE || (d = opendir(path)) == NULL)
+	{
+		warn(WL_fail, "runbatch", "Could not open directory \"%a\".\n", path);
+
+		return 0;
+	}
+
+	strcpy(dir, path);
+
+	if (dir[x - 1] != '/')
+		dir[x++] = '/', dir[x] = '\0';
+
+	while ((entry = readdir(d)) != NULL)
+	{
+		n = strlen(entry->d_name);
+
+		if (n <= (int)strlen(BA_EXP) || strcmp(entry->d_name + n - strlen(BA_EXP), BA_EXP) != 0)
+			continue;
+
+		if (!add(B, dir, x, entry->d_name))
+		{
+			closedir(d);
+
+			return 0;
+		}
+
+		/* only regular files, or links to them */
+		if (stat(B->paths[B->npaths - 1], &statbuf) != 0 || !S_ISREG(statbuf.st_mode))
+			free(B->paths[--B->npaths]);
+	}
+
+	closedir(d);
+	qsort(B->paths + first, B->npaths - first, sizeof(char *), compare);
+
+	return 1;
+}
+
+/* readlist: Add every experiment file listed in the file (path), one on each line, to the batch (B); blank lines and
+ * those that begin with a `#' are skipped, and a relative path is put after the directory of (path). Returns 0 on
+ * failure, and 1 on success.
+ */
+static int readlist(const char *path, struct batch *B)
+{
+	const char *slash = strrchr(path, '/');
+	char line[BA_LINESIZE], *p;
+	FILE *f;
+	int x = slash == NULL ? 0 : (int)(slash + 1 - path), i;
+
+	if ((f = fopen(path, "r")) == NULL)
+	{
+		warn(WL_fail, "runbatch", "Could not open list of experiment files \"%a\".\n", path);
+
+		return 0;
+	}
+
+	while (fgets(line, BA_LINESIZE, f) != NULL)
+	{
+		for (p = line; isspace((unsigned char)*p); ++p)
+			;
+
+		for (i = strlen(p); i > 0 && isspace((unsigned char)p[i - 1]); --i)
+			p[i - 1] = '\0';
+
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		if (!add(B, path, *p == '/' ? 0 : x, p))
+		{
+			fclose(f);
+
+			return 0;
+		}
+	}
+
+	fclose(f);
+
+	return 1;
+}
+
+/* name: Write into (name), with size BA_NAMESIZE, the name of the file beside the experiment file (path) with the
+ * extension (ext) in place of its own; after the number of (run) of (nruns), from 1, if there are more than one.
+ * Returns 0 if the name does not fit, and 1 otherwise.
+ */
+static int name(const char *path, int run, int nruns, const char *ext, char *name)
+{
+	int n = strlen(path), width;
+
+	if (n > (int)strlen(BA_EXP) && strcmp(path + n - strlen(BA_EXP), BA_EXP) == 0)
+		n -= strlen(BA_EXP);
+
+	if (n >= BA_NAMESIZE)
+		return 0;
+
+	memcpy(name, path, n);
+
+	/* as wide as the last, so that they are in order by name */
+	if (nruns > 1)
+	{
+		for (width = 1; nruns >= 10; nruns /= 10)
+			++width;
+
+		if ((n += snprintf(name + n, BA_NAMESIZE - n, ".%0*d", width, run + 1)) >= BA_NAMESIZE)
+			return 0;
+	}
+
+	if (n + strlen(ext) >= BA_NAMESIZE)
+		return 0;
+
+	strcpy(name + n, ext);
+
+	return 1;
+}
+
+/* render: Run (exp), which must have been initialized, and render it to the file (out). Returns 0 on failure, and
+ * 1 on success.
+ */
+static int render(struct exp *exp, const char *out)
+{
+	int r;
+
+	if ((exp->out = fopen(out, exp->binary ? "wb" : "w")) == NULL)
+	{
+		warn(WL_fail, "runbatch", "Could not open \"%a\" for the output of \"%a\".\n", out, exp->path);
+
+		return 0;
+	}
+
+	r = runexp(exp) && !ferror(exp->out);
+
+	if (fclose(exp->out) != 0)
+		r = 0;
+
+	exp->out = stdout;
+
+	if (!r)
+		warn(WL_fail, "runbatch", "Could not run experiment \"%a\" to \"%a\".\n", exp->path, out);
+
+	return r;
+}
+
+/* runone: Run the experiment file (path) with the options of the batch (B), and render it to a file beside it; or
+ * every run of its sweep, one after the other, if it has one. Returns 0 on failure, and 1 on success.
+ */
+static int runone(struct batch *B, const char *path)
+{
+	struct exp exp;
+	char out[BA_NAMESIZE];
+	int r = 0;
+
+	mkexp(&exp);
+	exp.binary = B->options->binary;
+	exp.realsize = B->options->realsize;
+	exp.fields = B->options->fields;
+	exp.stride = B->options->stride;
+	exp.pool.nthreads = B->options->pool.nthreads;
+	exp.stats.every = B->options->stats.every;
+	exp.stats.report = B->options->stats.report;
+
+	if (!name(path, 0, 1, exp.binary ? BA_BINARY : BA_TEXT, out))
+		warn(WL_fail, "runbatch", "Experiment file \"%a\" has too long a path for its output.\n", path);
+	else
+	if (!readexp(path, &exp))
+		warn(WL_fail, "runbatch", "Could not load experiment file \"%a\" properly.\n", path);
+	else
+	if (!initexp(&exp))
+		warn(WL_fail, "runbatch", "Could not initialize experiment \"%a\".\n", path);
+	else
+	if (exp.sweep != NULL)
+		r = runsweep(&exp, 1) == 0;
+	else
+	{
+		warn(WL_verbose, "runbatch", "Beginning %a, from \"%a\".\n", exp.title, path);
+
+		r = render(&exp, out);
+	}
+
+	freeexp(&exp);
+
+	return r;
+}
+
+/* setrun: Set the keys of (exp) swept over to their values in run (run) of the sweep of (base); or, if (objects),
+ * the fields of its objects.
+ */
+static void setrun(struct exp *exp, const struct exp *base, int run, int objects)
+{
+	struct particles *P = &exp->particles;
+	real *fields[SF_COLUMNS] = { P->x, P->y, D3(P->z,) P->vx, P->vy, D3(P->vz,) P->charge, P->mass }, v;
+	const struct sweep *sweep;
+	int rest;
+
+	/* the index of the value of each sweep is a digit of (run), in a base of its number of values */
+	for (sweep = base->sweep, rest = base->nruns; sweep != NULL; sweep = sweep->next)
+	{
+		rest /= sweep->nvalues;
+		v = sweep->values[run / rest % sweep->nvalues];
+
+		if ((sweep->key == SW_system) != objects)
+			continue;
+
+		switch (sweep->key)
+		{
+		case SW_delta:      exp->delta = v;                 break;
+		case SW_limit:      exp->limit = (int)ceil(v);      break;
+		case SW_theta:      exp->theta = v;                 break;
+		case SW_order:      exp->order = (int)v;            break;
+		case SW_tolerance:  exp->tolerance = v;             break;
+		case SW_softening:  exp->softening = v;             break;
+		case SW_encounter:  exp->encounter = v;             break;
+		case SW_cutoff:     exp->cutoff = v;                break;
+		case SW_screening:  exp->screening = v;             break;
+		case SW_mesh:       exp->mesh = (int)v;             break;
+		case SW_system:     fields[sweep->field][sweep->object] = v;  break;
+		}
+	}
+}
+
+/* runrun: Run the run (run) of the sweep of (base) as (exp), which keeps its memory from the last run it was used
+ * for, and render it to a file beside the experiment file. Returns 0 on failure, and 1 on success.
+ */
+static int runrun(struct exp *exp, const struct exp *base, int run)
+{
+	const struct particles *from = &base->particles;
+	struct particles *P = &exp->particles;
+	size_t size = base->nobjects * sizeof(real);
+	char out[BA_NAMESIZE];
+
+	strcpy(exp->title, base->title);
+	strcpy(exp->path, base->path);
+	exp->delta = base->delta;
+	exp->limit = base->limit;
+	exp->begin = base->begin;
+	exp->binary = base->binary;
+	exp->realsize = base->realsize;
+	exp->fields = base->fields;
+	exp->stride = base->stride;
+	exp->routine = base->routine;
+	exp->theta = base->theta;
+	exp->order = base->order;
+	exp->mesh = base->mesh;
+	exp->softening = base->softening;
+	exp->integrator = base->integrator;
+	exp->timestep = base->timestep;
+	exp->tolerance = base->tolerance;
+	exp->encounter = base->encounter;
+	exp->cutoff = base->cutoff;
+	exp->screening = base->screening;
+	exp->box = base->box;
+	exp->nobjects = base->nobjects;
+	exp->pool.nthreads = base->pool.nthreads;
+	exp->stats.every = base->stats.every;
+	exp->stats.report = base->stats.report;
+
+	setrun(exp, base, run, 0);
+
+	if (!initexp(exp))
+	{
+		warn(WL_fail, "runsweep", "Could not initialize run %i of \"%a\".\n", run + 1, base->path);
+
+		return 0;
+	}
+
+	/* the system, as it was read, shared by every run */
+	memcpy(P->x, from->x, size), memcpy(P->y, from->y, size);
+	memcpy(P->vx, from->vx, size), memcpy(P->vy, from->vy, size);
+	D3(memcpy(P->z, from->z, size), memcpy(P->vz, from->vz, size);)
+	memcpy(P->charge, from->charge, size), memcpy(P->mass, from->mass, size);
+
+	setrun(exp, base, run, 1);
+
+	warn(WL_verbose, "runsweep", "Beginning run %i of %i of %a.\n", run + 1, base->nruns, base->title);
+
+	if (!name(base->path, run, base->nruns, exp->binary ? BA_BINARY : BA_TEXT, out))
+	{
+		warn(WL_fail, "runsweep", "Experiment file \"%a\" has too long a path for the output of run %i.\n",
+		    base->path, run + 1);
+
+		return 0;
+	}
+
+	return render(exp, out);
+}
+
+/* worker: Run the experiments or runs of the batch structure (arg) in turn with the other workers, until none are
+ * left; the runs of a sweep are run in an experiment structure of the worker's own.
+ */
+static void *worker(void *arg)
+{
+	struct batch *B = (struct batch *)arg;
+	struct exp exp;
+	int i;
+
+	mkexp(&exp);
+
+	while ((i = incmutexint(&B->next) - 1) < B->n)
+		if (!(B->base != NULL ? runrun(&exp, B->base, i) : runone(B, B->paths[i])))
+			incmutexint(&B->failed);
+
+	freeexp(&exp);
+
+	return NULL;
+}
+
+/* pool: Run the experiments or runs of the batch (B) on (nworkers) threads, the calling thread among them. Returns the
+ * number that failed.
+ */
+static int pool(struct batch *B, int nworkers)
+{
+	pthread_t *threads = NULL;
+	int i, nthreads = 0, pthreadr;
+
+	if (nworkers > B->n)
+		nworkers = B->n;
+
+	pthread_mutex_init(&B->next.mutex, NULL);
+	pthread_mutex_init(&B->failed.mutex, NULL);
+	B->next.value = B->failed.value = 0;
+
+	warn(WL_verbose, "runbatch", "Running %i %a on %i workers.\n", B->n, B->base != NULL ? "runs" : "experiments", nworkers);
+
+	/* the calling thread is worker 0 */
+	if (nworkers > 1 && (threads = malloc((nworkers - 1) * sizeof(pthread_t))) == NULL)
+		warn(WL_crash, "runbatch", "malloc returned NULL when attempting allocation of the workers; running on one.\n");
+	else
+		for (; nthreads < nworkers - 1; ++nthreads)
+			if ((pthreadr = pthread_create(&threads[nthreads], NULL, worker, (void *)B)))
+			{
+				warn(WL_warn, "runbatch", "Could not create thread for a worker, (pthread_create) returned %i; running on %i.\n",
+				    pthreadr, nthreads + 1);
+
+				break;
+			}
+
+	worker(B);
+
+	for (i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&B->next.mutex);
+	pthread_mutex_destroy(&B->failed.mutex);
+
+	if (B->failed.value != 0)
+		warn(WL_warn, "runbatch", "%i of %i %a failed.\n", B->failed.value, B->n, B->base != NULL ? "runs" : "experiments");
+
+	return B->failed.value;
+}
+
+int runbatch(const char *path, int nworkers, const struct exp *options)
+{
+	struct batch B;
+	struct stat statbuf;
+	int i, r = -1;
+
+	B.paths = NULL;
+	B.npaths = B.size = 0;
+	B.options = options;
+	B.base = NULL;
+
+	if (stat(path, &statbuf) != 0)
+		warn(WL_fail, "runbatch", "Could not find \"%a\".\n", path);
+	else
+	if (!(S_ISDIR(statbuf.st_mode) ? readbatchdir(path, &B) : readlist(path, &B)))
+		;
+	else
+	if (B.npaths == 0)
+		warn(WL_fail, "runbatch", "No experiment files found in \"%a\".\n", path);
+	else
+		B.n = B.npaths, r = pool(&B, nworkers);
+
+	for (i = 0; i < B.npaths; ++i)
+		free(B.paths[i]);
+
+	free(B.paths);
+
+	return r;
+}
+
+int runsweep(struct exp *exp, int nworkers)
+{
+	static const char *keys[] = { SW_NAMES }, *fields[] = { "x", "y", D3("z",) "vx", "vy", D3("vz",) "charge", "mass" };
+	struct batch B;
+	const struct sweep *sweep;
+	char runs[BA_NAMESIZE];
+	FILE *f;
+	int k, rest;
+
+	/* the values of every run, in a table */
+	if (!name(exp->path, 0, 1, BA_RUNS, runs))
+	{
+		warn(WL_fail, "runsweep", "Experiment file \"%a\" has too long a path for its list of runs.\n", exp->path);
+
+		return -1;
+	}
+
+	if ((f = fopen(runs, "w")) == NULL)
+	{
+		warn(WL_fail, "runsweep", "Could not open \"%a\" for the list of runs.\n", runs);
+
+		return -1;
+	}
+
+	fprintf(f, "# run");
+
+	for (sweep = exp->sweep; sweep != NULL; sweep = sweep->next)
+		if (sweep->key == SW_system)
+			fprintf(f, " %s[%d]", fields[sweep->field], sweep->object);
+		else
+			fprintf(f, " %s", keys[sweep->key]);
+
+	fprintf(f, "\n");
+
+	/* the index of the value of each sweep is a digit of the run, as in (setrun) */
+	for (k = 0; k < exp->nruns; ++k)
+	{
+		fprintf(f, "%d", k + 1);
+
+		for (sweep = exp->sweep, rest = exp->nruns; sweep != NULL; sweep = sweep->next)
+		{
+			rest /= sweep->nvalues;
+			fprintf(f, " %Le", (long double)sweep->values[k / rest % sweep->nvalues]);
+		}
+
+		fprintf(f, "\n");
+	}
+
+	if (fclose(f) != 0)
+	{
+		warn(WL_fail, "runsweep", "Could not write the list of runs to \"%a\".\n", runs);
+
+		return -1;
+	}
+
+	B.paths = NULL;
+	B.npaths = 0;
+	B.options = NULL;
+	B.base = exp;
+	B.n = exp->nruns;
+
+	return pool(&B, nworkers);
+}
@@ -0,0 +1,518 @@
+/* qsimbench: Benchmark the routines of qsim over synthetic systems.
+ *
+ * qsimbench [-n sizes] [-g generators] [-r routines] [-t frames] [-j jobs] [-p pairs] [-x sizes] [-k sizes]
+ *
+ * For every generator, routine and size, each separated by commas in its option, a system is generated and run
+ * through the compiler for (frames) frames with nothing rendered, in a process of its own. A line is printed for
+ * each run, with the time taken per pair interaction, the frames compiled per second, and the peak resident
+ * memory of the process. A pair interaction is one object's force on another, so there are N * (N - 1) of them
+ * per frame whatever the routine; the time per pair interaction of barnes-hut or fmm may be compared with that of
+ * direct. The cutoff routine is run with a cutoff of BENCH_CUTOFF and screening of BENCH_SCREENING, so its forces
+ * are not those of the others, and its cost grows with N rather than N^2. The ewald routine is run in a periodic
+ * box as wide as the square (or cube, in three dimensions) the system is generated over, so its forces are those of
+ * the system's images too.
+ * The pm routine is run in open space, over the mesh it chooses for the system, and without a cutoff; its forces
+ * are only those of the mesh, and its cost grows with N and with the mesh.
+ * Runs of direct, symmetric or ewald with more than (pairs) pair interactions in total are skipped.
+ *
+ * The generators are:
+ * - uniform: protons and electrons at random, spread uniformly over a square, or a cube.
+ * - plummer: neutral masses in four clusters, each spread as a Plummer sphere seen from above; or as one.
+ * - plasma: as uniform, in equal numbers, with random thermal velocities.
+ * - lattice: protons and electrons alternating over a square lattice, or a cubic one.
+ *
+ * With -x, the routines are not run; instead, for each size, an experiment file of that many objects is written,
+ * with numbers in every form that it allows, and read by (readexp). A line is printed for each, with the rate at
+ * which it was read by (readexp), and the rate at which its characters alone are read from the same file; the
+ * difference is the time taken by parsing.
+ *
+ * With -k, the routines are not run either; instead, for each size, the forces of a uniform system of that many
+ * objects are calculated (frames) times on one thread by each kernel of the direct routine, and a line is printed
+ * for each with the pair interactions it calculated per second. The kernels are that of (direct), that of
+ * (directsimd) if this CPU has one, and (vectors), the pair math of (direct) before it was fused, for comparison.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "qsim.h"
+
+/* declare global variables */
+
+int             W_verbose = 0;
+pthread_mutex_t W_mutex   = PTHREAD_MUTEX_INITIALIZER;
+
+#define BENCH_NGEN       4
+#define BENCH_NROUTINES  7
+#define BENCH_NSIZES     16
+#define BENCH_SPACING    1e-3  /* mean distance between objects (m) */
+#define BENCH_DELTA      1e-9  /* delta-time (s) */
+#define BENCH_CUTOFF     4e-3  /* cutoff of the cutoff routine (m); about 50 objects are within it */
+#define BENCH_SCREENING  1e-3  /* screening length of the cutoff routine (m) */
+#define BENCH_CLUSTERS   4     /* clusters of the plummer generator */
+#define BENCH_PARSEPATH  "/tmp/qsimbench.XXXXXX"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+/* BENCH_root: Return the number of objects along each side of a square, or a cube, of (_n) objects. */
+#if DIM == 3
+#define BENCH_root(_n)  cbrt(_n)
+#else
+#define BENCH_root(_n)  sqrt(_n)
+#endif
+
+static const char *generators[BENCH_NGEN] = { "uniform", "plummer", "plasma", "lattice" };
+static const char *routines[BENCH_NROUTINES] = { "direct", "barnes-hut", "symmetric", "fmm", "cutoff", "ewald", "pm" };
+
+/* rnd: Return a random number in (0, 1), from a xorshift generator; the same sequence on every machine. */
+static unsigned long long seed;
+
+static double rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+
+	return ((seed >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/* gaussian: Return a random number from the normal distribution with a mean of 0 and a deviation of 1. */
+static double gaussian(void)
+{
+	return sqrt(-2 * log(rnd())) * cos(2 * M_PI * rnd());
+}
+
+/* generate: Fill the system of (exp) with (n) objects from generator (gen). Returns 0 on failure, and 1 on success. */
+static int generate(struct exp *exp, int gen, int n)
+{
+	struct object *o, **tail = &exp->system;
+	double side = BENCH_SPACING * BENCH_root(n), r, angle, u;
+	int i, k = (int)ceil(BENCH_root(n)), cluster;
+	vector centers[BENCH_CLUSTERS];
+
+	seed = 0x9e3779b97f4a7c15ULL + gen;
+
+	for (cluster = 0; cluster < BENCH_CLUSTERS; ++cluster)
+		centers[cluster] = V_make(side * rnd(), side * rnd(), side * rnd());
+
+	for (i = 0; i < n; ++i)
+	{
+		if ((o = malloc(sizeof(struct object))) == NULL)
+		{
+			warn(WL_crash, "generate", "malloc returned NULL when attempting allocation of an object.\n");
+			*tail = NULL;
+
+			return 0;
+		}
+
+		o->vel = V_make(0,0,0);
+
+		/* protons and electrons, unless changed below */
+		o->charge = i % 2 ? -EC : EC;
+		o->mass = i % 2 ? EM : PM;
+
+		switch (gen)
+		{
+		case 0:
+		/* uniform */
+			if (rnd() < 0.5)
+				o->charge = -EC, o->mass = EM;
+			else
+				o->charge = EC, o->mass = PM;
+
+			o->loc = V_make(side * rnd(), side * rnd(), side * rnd());
+
+			break;
+
+		case 1:
+		/* plummer; the radius of a Plummer sphere of radius (side / 16) holding a fraction (u) of its mass */
+			u = rnd() * 0.99;
+			r = side / 16 / sqrt(pow(u, -2.0 / 3) - 1);
+			angle = 2 * M_PI * rnd();
+			cluster = i % BENCH_CLUSTERS;
+
+#if DIM == 3
+			/* in a direction at random; (u) is now the cosine of its angle from the z-axis */
+			u = 2 * rnd() - 1;
+			o->loc = V_make(centers[cluster].x + r * sqrt(1 - u * u) * cos(angle),
+			                centers[cluster].y + r * sqrt(1 - u * u) * sin(angle), centers[cluster].z + r * u);
+#else
+			o->loc = V_make(centers[cluster].x + r * cos(angle), centers[cluster].y + r * sin(angle), 0);
+#endif
+			o->charge = 0;
+			o->mass = 1;
+
+			break;
+
+		case 2:
+		/* plasma; electrons and protons at the same temperature, so protons are slower */
+			o->loc = V_make(side * rnd(), side * rnd(), side * rnd());
+			o->vel = V_mul(V_make(gaussian(), gaussian(), gaussian()), 1e5 * sqrt(EM / o->mass));
+
+			break;
+
+		case 3:
+		/* lattice; neighbours have opposite charges */
+			o->loc = V_make(BENCH_SPACING * (i % k), BENCH_SPACING * (i / k D3(% k)), BENCH_SPACING * (i / k / k));
+			o->charge = (i % k + i / k D3(% k + i / k / k)) % 2 ? -EC : EC;
+			o->mass = (i % k + i / k D3(% k + i / k / k)) % 2 ? EM : PM;
+
+			break;
+		}
+
+		*tail = o;
+		tail = &o->next;
+	}
+
+	*tail = NULL;
+	exp->nobjects = n;
+
+	return 1;
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* bench: Run (frames) frames of (n) objects from generator (gen) with routine (routine) on (nthreads) threads, and
+ * print the results. Returns 0 on failure, and 1 on success.
+ */
+static int bench(int gen, int routine, int n, int frames, int nthreads)
+{
+	struct exp exp;
+	struct rusage ru;
+	double t;
+	int r = 0;
+
+	mkexp(&exp);
+	strcpy(exp.title, "qsimbench");
+	exp.delta = BENCH_DELTA;
+	exp.limit = frames;
+	exp.fields = 0;
+	exp.routine = routine;
+	exp.pool.nthreads = nthreads;
+
+	/* a screened plasma, for the routine made for it */
+	if (routine == RT_cutoff)
+		exp.cutoff = BENCH_CUTOFF, exp.screening = BENCH_SCREENING;
+
+	/* the square, or cube, of the generators, as a periodic box */
+	if (routine == RT_ewald)
+		exp.box = V_make(BENCH_SPACING * BENCH_root(n), BENCH_SPACING * BENCH_root(n), BENCH_SPACING * BENCH_root(n));
+
+	if (generate(&exp, gen, n) && initexp(&exp))
+	{
+		t = seconds();
+		r = runexp(&exp);
+		t = seconds() - t;
+
+		getrusage(RUSAGE_SELF, &ru);
+
+		/* (ru_maxrss) is in kilobytes, except on macOS */
+#if defined(__APPLE__)
+		ru.ru_maxrss /= 1024;
+#endif
+		if (r)
+			printf("%-8s %-10s %8d %6d %12.3f %10.3f %10.1f\n", generators[gen], routines[routine], n, frames,
+			    t * 1e9 / ((double)n * (n - 1) * frames), frames / t, ru.ru_maxrss / 1024.0);
+	}
+
+	freeexp(&exp);
+
+	return r;
+}
+
+/* vectors: Calculate forces as (direct) did before its pair math was fused; over vectors, with the magnitude of the
+ * radius taken twice, and its square once more, for every pair. Without softening, screening or
+ * a box, as the systems of (kernelbench) have none.
+ */
+static void vectors(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	int i, j;
+	vector radius, felec, fgrav;
+	real rsquared;
+
+	for (i = from; i < to; ++i)
+	{
+		felec = V_make(0,0,0);
+		fgrav = V_make(0,0,0);
+
+		for (j = 0; j < exp->nobjects; ++j)
+		{
+			if (j == i)
+				continue;
+
+			radius = V_make(P->x[j] - P->x[i], P->y[j] - P->y[i], P->z[j] - P->z[i]);
+			rsquared = powr(V_get(radius), 2);
+
+			felec = V_sub(felec, V_set(radius, P->charge[j] / rsquared));
+			fgrav = V_add(fgrav, V_set(radius, P->mass[j] / rsquared));
+		}
+
+		felec = V_mul(felec, K * P->charge[i]);
+		fgrav = V_mul(fgrav, G * P->mass[i]);
+
+		P->fex[i] = felec.x, P->fey[i] = felec.y D3(, P->fez[i] = felec.z);
+		P->fgx[i] = fgrav.x, P->fgy[i] = fgrav.y D3(, P->fgz[i] = fgrav.z);
+	}
+}
+
+/* kernelbench: Time each kernel of the direct routine over (frames) calculations of the forces of a uniform system
+ * of (n) objects, and print the results. Returns 0 on failure, and 1 on success.
+ */
+static int kernelbench(int n, int frames)
+{
+	static const char *names[] = { "vectors", "direct", NULL };
+	void (*kernels[])(struct exp *, int, int) = { vectors, direct, directsimd };
+	struct exp exp;
+	double t;
+	int k, f, r = 0;
+
+	names[2] = simd();
+	mkexp(&exp);
+	strcpy(exp.title, "qsimbench");
+	exp.delta = BENCH_DELTA;
+	exp.limit = 1;
+	exp.fields = 0;
+
+	if (generate(&exp, 0, n) && initexp(&exp))
+	{
+		for (k = 0; k < 3 && names[k] != NULL; ++k)
+		{
+			t = seconds();
+
+			for (f = 0; f < frames; ++f)
+				kernels[k](&exp, 0, n);
+
+			t = seconds() - t;
+			printf("%8d %-8s %14.4e %12.3f\n", n, names[k], (double)n * (n - 1) * frames / t,
+			    t * 1e9 / ((double)n * (n - 1) * frames));
+		}
+
+		r = 1;
+	}
+
+	freeexp(&exp);
+
+	return r;
+}
+
+/* readbench: Write an experiment file of (n) objects, and time reading it by (readexp), and by characters alone; and
+ * print the results. Returns 0 on failure, and 1 on success.
+ */
+static int readbench(int n)
+{
+	/* every form of a datum; locations, velocities, then charges and masses */
+	static const char *forms[] = {
+		"%.17gm, %.17gm, ", "%.17g mm, %.17g mm, ", "%.6em, %.6eum, ", "%.6E km, %.6E nm, ",
+		"%.3gm/s, %.3gm/s, ", "%.9e km/s, %.9e m/s, ", "%.2gmm/s, %.2gmm/s, ", "%.17g m/s, %.17g m/s, "
+	};
+	static const char *kinds[] = { "-1e, em", "+1e, pm", "0e, nm", "1.602176634e-19C, 1.007276466621u" };
+	struct exp exp;
+	char path[] = BENCH_PARSEPATH;
+	double t, tread;
+	long size = 0;
+	FILE *f;
+	int fd, i, r;
+
+	if ((fd = mkstemp(path)) == -1 || (f = fdopen(fd, "w")) == NULL)
+	{
+		fprintf(stderr, "(fail) qsimbench: Could not create an experiment file.\n");
+
+		return 0;
+	}
+
+	seed = 0x9e3779b97f4a7c15ULL;
+	fprintf(f, "title: qsimbench; delta: 1ns; limit: 1fr.;\nsystem:\n");
+
+	for (i = 0; i < n; ++i)
+	{
+		fprintf(f, forms[i % 4], rnd(), rnd());
+		D3(fprintf(f, "%.17gm, ", rnd());)
+		fprintf(f, forms[4 + i / 4 % 4], 1e5 * gaussian(), 1e5 * gaussian());
+		D3(fprintf(f, "%.17g m/s, ", 1e5 * gaussian());)
+		fputs(kinds[i % 4], f);
+		fputs(i == n - 1 ? ";\n" : "\n", f);
+	}
+
+	fclose(f);
+
+	/* the characters alone, as they are read by (readexp), from the cache as the file has just been written */
+	t = seconds();
+
+	if ((f = fopen(path, "r")) != NULL)
+	{
+		while (getc_unlocked(f) != EOF)
+			++size;
+
+		fclose(f);
+	}
+
+	tread = seconds() - t;
+
+	mkexp(&exp);
+	t = seconds();
+	r = readexp(path, &exp);
+	t = seconds() - t;
+
+	if (r)
+		printf("%8d %10.1f %12.1f %12.1f %12.0f\n", n, size / 1e6, size / 1e6 / tread, size / 1e6 / t, n / t);
+	else
+		fprintf(stderr, "(fail) qsimbench: Could not read the experiment file of %d objects.\n", n);
+
+	freeexp(&exp);
+	remove(path);
+
+	return r;
+}
+
+/* parse: Parse the list (arg) of names or numbers separated by commas into (arr), with size (narr); names are
+ * looked up in (names), with size (nnames), unless it is NULL. Returns the number parsed, or -1 on failure.
+ */
+static int parse(char *arg, int *arr, int narr, const char **names, int nnames)
+{
+	char *name;
+	int n = 0, i;
+
+	for (name = strtok(arg, ","); name != NULL; name = strtok(NULL, ","))
+	{
+		if (n == narr)
+			return -1;
+
+		if (names == NULL)
+		/* a number of objects; at least 2 */
+		{
+			if ((arr[n] = (int)atof(name)) < 2)
+				return -1;
+		} else {
+			for (i = 0; i < nnames && strcmp(name, names[i]) != 0; ++i)
+				;
+
+			if (i == nnames)
+				return -1;
+
+			arr[n] = i;
+		}
+
+		++n;
+	}
+
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	int sizes[BENCH_NSIZES] = { 100, 1000, 10000, 100000, 1000000 }, nsizes = 5;
+	int gens[BENCH_NGEN] = { 0, 1, 2, 3 }, ngens = BENCH_NGEN;
+	int rts[BENCH_NROUTINES] = { RT_direct, RT_symmetric, RT_barneshut, RT_fmm, RT_cutoff, RT_ewald, RT_pm }, nrts = BENCH_NROUTINES;
+	int xsizes[BENCH_NSIZES], nxsizes = 0, ksizes[BENCH_NSIZES], nksizes = 0;
+	int frames = 5, nthreads = 1, argi, g, k, i, status, r = EXIT_SUCCESS;
+	double pairs = 1e10;
+	pid_t pid;
+
+	for (argi = 1; argi < argc; ++argi)
+	{
+		if (argv[argi][0] != '-' || argv[argi][1] == '\0' || argv[argi][2] != '\0' || argi + 1 == argc)
+		{
+			fprintf(stderr, "(fail) qsimbench: Unknown argument \"%s\", or no value provided after it.\n", argv[argi]);
+
+			return EXIT_FAILURE;
+		}
+
+		switch (argv[argi][1])
+		{
+		case 'n': nsizes = parse(argv[++argi], sizes, BENCH_NSIZES, NULL, 0); break;
+		case 'g': ngens = parse(argv[++argi], gens, BENCH_NGEN, generators, BENCH_NGEN); break;
+		case 'r': nrts = parse(argv[++argi], rts, BENCH_NROUTINES, routines, BENCH_NROUTINES); break;
+		case 't': frames = atoi(argv[++argi]); break;
+		case 'j': nthreads = atoi(argv[++argi]); break;
+		case 'p': pairs = atof(argv[++argi]); break;
+		case 'x': nxsizes = parse(argv[++argi], xsizes, BENCH_NSIZES, NULL, 0); break;
+		case 'k': nksizes = parse(argv[++argi], ksizes, BENCH_NSIZES, NULL, 0); break;
+		default:
+			fprintf(stderr, "(fail) qsimbench: Unknown option \"%s\".\n", argv[argi]);
+
+			return EXIT_FAILURE;
+		}
+
+		if (nsizes < 1 || ngens < 1 || nrts < 1 || frames < 1 || nthreads < 1 || nxsizes < 0 || nksizes < 0)
+		{
+			fprintf(stderr, "(fail) qsimbench: Value \"%s\" of option \"%s\" is not valid.\n", argv[argi], argv[argi - 1]);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (nxsizes > 0)
+	{
+		printf("%8s %10s %12s %12s %12s\n", "objects", "MB", "read MB/s", "parse MB/s", "objects/s");
+
+		for (i = 0; i < nxsizes; ++i)
+			if (!readbench(xsizes[i]))
+				r = EXIT_FAILURE;
+
+		return r;
+	}
+
+	if (nksizes > 0)
+	{
+		printf("%8s %-8s %14s %12s\n", "objects", "kernel", "pairs/s", "ns/pair");
+
+		for (i = 0; i < nksizes; ++i)
+			if (!kernelbench(ksizes[i], frames))
+				r = EXIT_FAILURE;
+
+		return r;
+	}
+
+	printf("%-8s %-10s %8s %6s %12s %10s %10s\n", "system", "routine", "objects", "frames", "ns/pair", "frames/s", "peak MB");
+
+	for (g = 0; g < ngens; ++g)
+		for (k = 0; k < nrts; ++k)
+			for (i = 0; i < nsizes; ++i)
+			{
+				if ((rts[k] == RT_direct || rts[k] == RT_symmetric || rts[k] == RT_ewald) && (double)sizes[i] * sizes[i] * frames > pairs)
+				{
+					printf("%-8s %-10s %8d %6d %12s\n", generators[gens[g]], routines[rts[k]], sizes[i], frames, "skipped");
+
+					continue;
+				}
+
+				/* every run is in a process of its own, so that its peak memory is its own */
+				fflush(stdout);
+
+				if ((pid = fork()) == -1)
+				{
+					fprintf(stderr, "(fail) qsimbench: Could not fork.\n");
+
+					return EXIT_FAILURE;
+				}
+
+				if (pid == 0)
+					exit(bench(gens[g], rts[k], sizes[i], frames, nthreads) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+				if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+				{
+					printf("%-8s %-10s %8d %6d %12s\n", generators[gens[g]], routines[rts[k]], sizes[i], frames, "failed");
+					r = EXIT_FAILURE;
+				}
+			}
+
+	return r;
+}
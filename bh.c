@@ -0,0 +1,272 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "qsim.h"
+
+#define BH_LEAFSIZE  8   /* objects a leaf may hold before it is split into quadrants */
+#define BH_MAXDEPTH  48  /* depth at which leaves are no longer split, for objects that share a location */
+#define BH_NCHILD    (1 << DIM)  /* quadrants of a cell; octants in three dimensions */
+#define BH_STACKSIZE ((BH_NCHILD - 1) * BH_MAXDEPTH + BH_NCHILD)
+
+/* mkcell: Append a leaf cell to (tree), returning its index, or -1 if memory could not be allocated. */
+static int mkcell(struct tree *tree, vector center, real half)
+{
+	struct cell *cells, *cell;
+	int size, k;
+
+	if (tree->ncells == tree->size)
+	{
+		size = tree->size == 0 ? 64 : tree->size * 2;
+
+		if ((cells = realloc(tree->cells, size * sizeof(struct cell))) == NULL)
+			return -1;
+
+		tree->cells = cells;
+		tree->size = size;
+	}
+
+	cell = &tree->cells[tree->ncells];
+	cell->center = center;
+	cell->half = half;
+	cell->charge = cell->mass = (real)0;
+	cell->qdip = cell->mdip = V_make(0,0,0);
+
+	for (k = 0; k < BH_NCHILD; ++k)
+		cell->child[k] = -1;
+
+	cell->first = -1;
+	cell->count = 0;
+
+	return tree->ncells++;
+}
+
+/* quadrant of the location (_l) in the cell (_c) */
+#define BH_quadrant(_c, _l)  (((_l).x >= (_c)->center.x) | (((_l).y >= (_c)->center.y) << 1) \
+                              D3(| (((_l).z >= (_c)->center.z) << 2)))
+
+/* insert: Insert object (i) into the cell (c) at depth (depth). Returns 0 on failure, and 1 on success. */
+static int insert(struct tree *tree, struct particles *P, int c, int i, int depth)
+{
+	struct cell *cell;
+	vector center;
+	real half;
+	int q, n, j, list;
+
+	for (;; ++depth)
+	{
+		cell = &tree->cells[c];
+
+		if (cell->count != -1)
+		/* leaf */
+		{
+			tree->next[i] = cell->first;
+			cell->first = i;
+
+			if (++cell->count <= BH_LEAFSIZE || depth == BH_MAXDEPTH)
+				return 1;
+
+			/* split the leaf into quadrants, and insert its objects into them */
+			list = cell->first;
+			cell->first = -1;
+			cell->count = -1;
+
+			for (j = list; j != -1; j = list)
+			{
+				list = tree->next[j];
+
+				if (!insert(tree, P, c, j, depth))
+					return 0;
+			}
+
+			return 1;
+		}
+
+		q = BH_quadrant(cell, V_make(P->x[i], P->y[i], P->z[i]));
+
+		if (cell->child[q] == -1)
+		{
+			half = cell->half / 2;
+			center = V_make(cell->center.x + (q & 1 ? half : -half),
+			                cell->center.y + (q & 2 ? half : -half),
+			                cell->center.z + (q & 4 ? half : -half));
+
+			if ((n = mkcell(tree, center, half)) == -1)
+				return 0;
+
+			/* (mkcell) may have moved the cells */
+			tree->cells[c].child[q] = n;
+		}
+
+		c = tree->cells[c].child[q];
+	}
+}
+
+int mktree(struct exp *exp)
+{
+	struct tree *tree = &exp->tree;
+	struct particles *P = &exp->particles;
+	struct cell *cell, *child;
+	vector min, max, loc;
+	real half;
+	int c, i, k;
+
+	if (tree->next == NULL
+	 && (tree->next = malloc(exp->nobjects * sizeof(int))) == NULL)
+		goto mktree_fail;
+
+	/* bounds of the root cell */
+	min = max = V_make(P->x[0], P->y[0], P->z[0]);
+
+	for (i = 1; i < exp->nobjects; ++i)
+	{
+		loc = V_make(P->x[i], P->y[i], P->z[i]);
+
+		min.x = loc.x < min.x ? loc.x : min.x;
+		min.y = loc.y < min.y ? loc.y : min.y;
+		max.x = loc.x > max.x ? loc.x : max.x;
+		max.y = loc.y > max.y ? loc.y : max.y;
+		D3(min.z = loc.z < min.z ? loc.z : min.z;)
+		D3(max.z = loc.z > max.z ? loc.z : max.z;)
+	}
+
+	half = (max.x - min.x > max.y - min.y ? max.x - min.x : max.y - min.y) / 2;
+	D3(half = max.z - min.z > 2 * half ? (max.z - min.z) / 2 : half;)
+
+	if (half == (real)0)
+		half = (real)1;
+
+	tree->ncells = 0;
+
+	if (mkcell(tree, V_div(V_add(min, max), 2), half * (real)1.0001) == -1)
+		goto mktree_fail;
+
+	for (i = 0; i < exp->nobjects; ++i)
+		if (!insert(tree, P, 0, i, 0))
+			goto mktree_fail;
+
+	/* quadrants are always appended after their cell, so moments may be summed from the last cell to the root */
+	for (c = tree->ncells - 1; c >= 0; --c)
+	{
+		cell = &tree->cells[c];
+
+		if (cell->count != -1)
+			for (i = cell->first; i != -1; i = tree->next[i])
+			{
+				loc = V_sub(V_make(P->x[i], P->y[i], P->z[i]), cell->center);
+
+				cell->charge += P->charge[i];
+				cell->mass += P->mass[i];
+				cell->qdip = V_add(cell->qdip, V_mul(loc, P->charge[i]));
+				cell->mdip = V_add(cell->mdip, V_mul(loc, P->mass[i]));
+			}
+		else
+			for (k = 0; k < BH_NCHILD; ++k)
+			{
+				if (cell->child[k] == -1)
+					continue;
+
+				child = &tree->cells[cell->child[k]];
+				loc = V_sub(child->center, cell->center);
+
+				cell->charge += child->charge;
+				cell->mass += child->mass;
+				cell->qdip = V_add(cell->qdip, V_add(child->qdip, V_mul(loc, child->charge)));
+				cell->mdip = V_add(cell->mdip, V_add(child->mdip, V_mul(loc, child->mass)));
+			}
+	}
+
+	return 1;
+
+mktree_fail:
+	warn(WL_crash, "mktree", "(malloc|realloc) returned NULL when attempting to build the tree.\n");
+
+	return 0;
+}
+
+void barneshut(struct exp *exp, int from, int to)
+{
+	struct tree *tree = &exp->tree;
+	struct particles *P = &exp->particles;
+	struct cell *cell;
+	int stack[BH_STACKSIZE], nstack, i, j, k;
+	vector loc, radius, qpull, mpull;
+	real rsquared, r, r3, r5, qdot, mdot, theta2 = exp->theta * exp->theta;
+	real e2 = exp->softening * exp->softening;
+
+	for (i = from; i < to; ++i)
+	{
+		loc = V_make(P->x[i], P->y[i], P->z[i]);
+
+		/* The pull vectors are the sums of each charge and mass over the cube of its
+		 * distance, in the direction from object (i) towards it. */
+		qpull = mpull = V_make(0,0,0);
+
+		stack[0] = 0;
+		nstack = 1;
+
+		while (nstack)
+		{
+			cell = &tree->cells[stack[--nstack]];
+
+			if (cell->count != -1)
+			/* leaf; sum its objects directly, softened as in (direct) */
+			{
+				for (j = cell->first; j != -1; j = tree->next[j])
+				{
+					if (j == i)
+						continue;
+
+					radius = V_make(P->x[j] - loc.x, P->y[j] - loc.y, P->z[j] - loc.z);
+					rsquared = radius.x * radius.x + radius.y * radius.y D3(+ radius.z * radius.z) + e2;
+					r3 = rsquared * sqrtr(rsquared);
+
+					qpull = V_add(qpull, V_mul(radius, P->charge[j] / r3));
+					mpull = V_add(mpull, V_mul(radius, P->mass[j] / r3));
+				}
+
+				continue;
+			}
+
+			/* The radius vector here is from the cell's center towards object (i). */
+			radius = V_sub(loc, cell->center);
+			rsquared = radius.x * radius.x + radius.y * radius.y D3(+ radius.z * radius.z);
+
+			if (4 * cell->half * cell->half < theta2 * rsquared
+			 && (fabsr(radius.x) > cell->half || fabsr(radius.y) > cell->half D3(|| fabsr(radius.z) > cell->half)))
+			/* far enough away; sum the cell by its monopole and dipole moments */
+			{
+				r = sqrtr(rsquared);
+				r3 = rsquared * r;
+				r5 = r3 * rsquared;
+				qdot = radius.x * cell->qdip.x + radius.y * cell->qdip.y D3(+ radius.z * cell->qdip.z);
+				mdot = radius.x * cell->mdip.x + radius.y * cell->mdip.y D3(+ radius.z * cell->mdip.z);
+
+				qpull = V_add(qpull, V_sub(V_div(cell->qdip, r3), V_mul(radius, cell->charge / r3 + 3 * qdot / r5)));
+				mpull = V_add(mpull, V_sub(V_div(cell->mdip, r3), V_mul(radius, cell->mass / r3 + 3 * mdot / r5)));
+
+				continue;
+			}
+
+			for (k = 0; k < BH_NCHILD; ++k)
+				if (cell->child[k] != -1)
+					stack[nstack++] = cell->child[k];
+		}
+
+		/* as in (direct), electrostatic force repels like-charges and gravitational force attracts */
+		P->fex[i] = qpull.x * -K * P->charge[i], P->fey[i] = qpull.y * -K * P->charge[i];
+		P->fgx[i] = mpull.x * G * P->mass[i], P->fgy[i] = mpull.y * G * P->mass[i];
+		D3(P->fez[i] = qpull.z * -K * P->charge[i], P->fgz[i] = mpull.z * G * P->mass[i];)
+	}
+}
+
+void freetree(struct tree *tree)
+{
+	free(tree->cells);
+	free(tree->next);
+
+	tree->cells = NULL;
+	tree->next = NULL;
+	tree->ncells = tree->size = 0;
+}
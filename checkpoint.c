@@ -0,0 +1,386 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "qsim.h"
+
+/* arrays of reals and of integers in the state of (_exp), after its header */
+#define CK_nreals(_exp)  ((_exp)->timestep == TS_block ? 6 * DIM + 2 : 4 * DIM + 2)
+#define CK_MAXREALS      (6 * DIM + 2)
+#define CK_nints(_exp)   ((_exp)->timestep == TS_block ? 1 : 0)
+
+/* size of the state of (_exp), with its header */
+#define CK_size(_exp)  (sizeof(struct ckheader) \
+                        + (size_t)(_exp)->nobjects * (CK_nreals(_exp) * sizeof(real) + CK_nints(_exp) * sizeof(int)))
+
+/* arrays: Set (a) to the arrays of reals of the particles of (exp) that are held in its state, in order; and
+ * return the levels of block time steps, or NULL.
+ */
+static int *arrays(struct exp *exp, real **a)
+{
+	struct particles *P = &exp->particles;
+
+	*a++ = P->x, *a++ = P->y, D3(*a++ = P->z,) *a++ = P->vx, *a++ = P->vy, D3(*a++ = P->vz,) *a++ = P->charge, *a++ = P->mass;
+	*a++ = P->fex, *a++ = P->fey, D3(*a++ = P->fez,) *a++ = P->fgx, *a++ = P->fgy D3(, *a++ = P->fgz);
+
+	if (exp->timestep != TS_block)
+		return NULL;
+
+	*a++ = P->ax, *a++ = P->ay, D3(*a++ = P->az,) *a++ = P->jx, *a++ = P->jy D3(, *a++ = P->jz);
+
+	return P->level;
+}
+
+/* take: Copy the state of (exp), at frame (n), into its checkpoint's state. */
+static void take(struct exp *exp, int n)
+{
+	struct ckheader *h = exp->checkpoint.state;
+	size_t size = exp->nobjects * sizeof(real);
+	unsigned char *p = (unsigned char *)(h + 1);
+	real *a[CK_MAXREALS];
+	int *level = arrays(exp, a), k;
+
+	/* zero the padding, so that checkpoints do not depend on the stack */
+	memset(h, 0, sizeof(struct ckheader));
+
+	memcpy(h->magic, CK_MAGIC, sizeof(CK_MAGIC));
+	h->version = CK_VERSION;
+	h->realsize = sizeof(real);
+	h->dimensions = DIM;
+	h->nobjects = exp->nobjects;
+	h->n = n;
+	h->limit = exp->limit;
+	h->routine = exp->routine;
+	h->order = exp->order;
+	h->mesh = exp->mesh;
+	h->integrator = exp->integrator;
+	h->timestep = exp->timestep;
+	h->fresh = exp->particles.fresh;
+	h->delta = exp->delta;
+	h->theta = exp->theta;
+	h->softening = exp->softening;
+	h->tolerance = exp->tolerance;
+	h->encounter = exp->encounter;
+	h->cutoff = exp->cutoff;
+	h->screening = exp->screening;
+	h->box = exp->box;
+	h->h = exp->particles.h;
+	strcpy(h->title, exp->title);
+
+	for (k = 0; k < CK_nreals(exp); ++k)
+		memcpy(p, a[k], size), p += size;
+
+	if (level != NULL)
+		memcpy(p, level, exp->nobjects * sizeof(int));
+}
+
+/* writer: Write every checkpoint of the experiment structure (arg) taken by (checkpoint) to a file beside its path,
+ * and put it in place of the last once the frames before it have been rendered; until told to quit.
+ */
+static void *writer(void *arg)
+{
+	struct exp *exp = (struct exp *)arg;
+	struct checkpoint *ck = &exp->checkpoint;
+	char tmp[exp_PATHSIZE + 4];
+	FILE *f;
+	int ok;
+
+	warn(WL_verbose, "writer", "Initialized.\n");
+
+	strcpy(tmp, ck->path);
+	strcat(tmp, ".tmp");
+
+	pthread_mutex_lock(&ck->mutex);
+
+	for (;;)
+	{
+		while (ck->pending == -1 && !ck->quit)
+			pthread_cond_wait(&ck->cond, &ck->mutex);
+
+		if (ck->pending == -1)
+			break;
+
+		/* the compiler does not touch the state while a checkpoint is pending */
+		pthread_mutex_unlock(&ck->mutex);
+
+		ok = (f = fopen(tmp, "wb")) != NULL
+		  && fwrite(ck->state, ck->size, 1, f) == 1
+		  && fflush(f) == 0
+		  && fsync(fileno(f)) == 0;
+
+		if (f != NULL && fclose(f) != 0)
+			ok = 0;
+
+		pthread_mutex_lock(&ck->mutex);
+
+		while (!ck->flushed && !ck->quit)
+			pthread_cond_wait(&ck->cond, &ck->mutex);
+
+		if (!ok || (ck->flushed && rename(tmp, ck->path) != 0))
+			warn(WL_warn, "writer", "Could not write the checkpoint of frame %i to \"%a\".\n", ck->pending, ck->path);
+		else
+		if (ck->flushed)
+			warn(WL_verbose, "writer", "Wrote the checkpoint of frame %i.\n", ck->pending);
+		else
+		/* stopped before the frames before it were rendered; the last checkpoint is left in place */
+			remove(tmp);
+
+		ck->pending = -1;
+	}
+
+	pthread_mutex_unlock(&ck->mutex);
+
+	warn(WL_verbose, "writer", "Terminated.\n");
+
+	return NULL;
+}
+
+int mkwriter(struct exp *exp)
+{
+	struct checkpoint *ck = &exp->checkpoint;
+	int pthreadr;
+
+	if (ck->every == 0)
+		return 1;
+
+	ck->size = CK_size(exp);
+
+	if ((ck->state = malloc(ck->size)) == NULL)
+	{
+		warn(WL_crash, "mkwriter", "malloc returned NULL after attempting to allocate memory for checkpoints.\n");
+
+		return 0;
+	}
+
+	ck->last = exp->begin;
+	ck->pending = -1;
+	ck->flushed = ck->quit = 0;
+	pthread_mutex_init(&ck->mutex, NULL);
+	pthread_cond_init(&ck->cond, NULL);
+
+	if ((pthreadr = pthread_create(&ck->thread, NULL, writer, (void *)exp)))
+	{
+		warn(WL_fail, "mkwriter", "Could not create thread for the writer, (pthread_create) returned %i.\n", pthreadr);
+		freewriter(exp);
+
+		return 0;
+	}
+
+	ck->running = 1;
+
+	return 1;
+}
+
+void freewriter(struct exp *exp)
+{
+	struct checkpoint *ck = &exp->checkpoint;
+
+	if (ck->every == 0 || ck->state == NULL)
+		return;
+
+	if (ck->running)
+	{
+		pthread_mutex_lock(&ck->mutex);
+		ck->quit = 1;
+		pthread_cond_signal(&ck->cond);
+		pthread_mutex_unlock(&ck->mutex);
+
+		pthread_join(ck->thread, NULL);
+		ck->running = 0;
+	}
+
+	pthread_mutex_destroy(&ck->mutex);
+	pthread_cond_destroy(&ck->cond);
+	free(ck->state);
+	ck->state = NULL;
+}
+
+void checkpoint(struct exp *exp, int n)
+{
+	struct checkpoint *ck = &exp->checkpoint;
+	int busy;
+
+	if (ck->every == 0 || n - ck->last < ck->every)
+		return;
+
+	pthread_mutex_lock(&ck->mutex);
+	busy = ck->pending != -1;
+	pthread_mutex_unlock(&ck->mutex);
+
+	if (busy)
+	/* never wait on the writer; try again at the next frame */
+	{
+		warn(WL_verbose, "checkpoint", "Still writing the last checkpoint at frame %i, putting this one off.\n", n);
+
+		return;
+	}
+
+	take(exp, n);
+
+	pthread_mutex_lock(&ck->mutex);
+	ck->pending = ck->last = n;
+	ck->flushed = 0;
+	pthread_cond_signal(&ck->cond);
+	pthread_mutex_unlock(&ck->mutex);
+}
+
+void rendered(struct exp *exp, int next)
+{
+	struct checkpoint *ck = &exp->checkpoint;
+
+	if (ck->every == 0)
+		return;
+
+	pthread_mutex_lock(&ck->mutex);
+
+	if (ck->pending != -1 && !ck->flushed && next >= ck->pending)
+	{
+		fflush(exp->out);
+		ck->flushed = 1;
+		pthread_cond_signal(&ck->cond);
+	}
+
+	pthread_mutex_unlock(&ck->mutex);
+}
+
+int readcheckpoint(const char *path, struct exp *exp)
+{
+	struct ckheader h;
+	struct object *o, **tail = &exp->system;
+	real *a[CK_MAXREALS];
+	FILE *f;
+	int i, n;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		return 0;
+
+	if (fread(&h, sizeof(struct ckheader), 1, f) != 1
+	 || memcmp(h.magic, CK_MAGIC, sizeof(CK_MAGIC)) != 0)
+	{
+		warn(WL_fail, "readcheckpoint", "\"%a\" is not a checkpoint of qsim.\n", path);
+		fclose(f);
+
+		return 0;
+	}
+
+	if (h.version != CK_VERSION || h.realsize != (int)sizeof(real))
+	{
+		warn(WL_fail, "readcheckpoint", "\"%a\" is of version %i with reals of %i bytes; only version %i with reals of %i bytes is known.\n",
+		    path, h.version, h.realsize, CK_VERSION, (int)sizeof(real));
+		fclose(f);
+
+		return 0;
+	}
+
+	if (h.dimensions != DIM)
+	{
+		warn(WL_fail, "readcheckpoint", "\"%a\" is of a system in %i dimensions; only those in %i are known.\n",
+		    path, h.dimensions, DIM);
+		fclose(f);
+
+		return 0;
+	}
+
+	/* the title must end within its array, and the routine and steps must be known ones */
+	if (h.nobjects < 1 || h.n < 1 || h.n > h.limit || memchr(h.title, '\0', exp_TITLESIZE) == NULL
+	 || h.routine < RT_direct || h.routine > RT_pm || h.integrator < IN_euler || h.integrator > IN_rk4
+	 || h.timestep < TS_fixed || h.timestep > TS_block)
+	{
+		warn(WL_fail, "readcheckpoint", "Checkpoint \"%a\" is not valid.\n", path);
+		fclose(f);
+
+		return 0;
+	}
+
+	strcpy(exp->title, h.title);
+	strcpy(exp->path, path);
+	exp->delta = h.delta;
+	exp->limit = h.limit;
+	exp->begin = h.n;
+	exp->routine = h.routine;
+	exp->theta = h.theta;
+	exp->order = h.order;
+	exp->mesh = h.mesh;
+	exp->softening = h.softening;
+	exp->integrator = h.integrator;
+	exp->timestep = h.timestep;
+	exp->tolerance = h.tolerance;
+	exp->encounter = h.encounter;
+	exp->cutoff = h.cutoff;
+	exp->screening = h.screening;
+	exp->box = h.box;
+	exp->nobjects = n = h.nobjects;
+
+	/* the state is kept whole until (resume) */
+	if ((exp->checkpoint.state = malloc(CK_size(exp))) == NULL)
+	{
+		warn(WL_crash, "readcheckpoint", "malloc returned NULL after attempting to allocate memory for the checkpoint.\n");
+		fclose(f);
+
+		return 0;
+	}
+
+	*exp->checkpoint.state = h;
+
+	if (fread(exp->checkpoint.state + 1, CK_size(exp) - sizeof(struct ckheader), 1, f) != 1)
+	{
+		warn(WL_fail, "readcheckpoint", "Checkpoint \"%a\" is cut short.\n", path);
+		fclose(f);
+
+		return 0;
+	}
+
+	fclose(f);
+
+	for (i = 0, a[0] = (real *)(exp->checkpoint.state + 1); i < 2 * DIM + 1; ++i)
+		a[i + 1] = a[i] + n;
+
+	/* the system, as (readexp) would have read it */
+	for (i = 0; i < n; ++i)
+	{
+		if ((o = malloc(sizeof(struct object))) == NULL)
+		{
+			warn(WL_crash, "readcheckpoint", "malloc returned NULL when attempting allocation of an object.\n");
+			*tail = NULL;
+
+			return 0;
+		}
+
+		o->loc = V_make(a[0][i], a[1][i], a[2][i]);
+		o->vel = V_make(a[DIM][i], a[DIM + 1][i], a[5][i]);
+		o->charge = a[2 * DIM][i];
+		o->mass = a[2 * DIM + 1][i];
+
+		*tail = o;
+		tail = &o->next;
+	}
+
+	*tail = NULL;
+
+	warn(WL_verbose, "readcheckpoint", "Resuming %a from frame %i.\n", exp->title, exp->begin);
+
+	return 1;
+}
+
+void resume(struct exp *exp)
+{
+	struct ckheader *h = exp->checkpoint.state;
+	size_t size = exp->nobjects * sizeof(real);
+	unsigned char *p = (unsigned char *)(h + 1);
+	real *a[CK_MAXREALS];
+	int *level = arrays(exp, a), k;
+
+	for (k = 0; k < CK_nreals(exp); ++k)
+		memcpy(a[k], p, size), p += size;
+
+	if (level != NULL)
+		memcpy(level, p, exp->nobjects * sizeof(int));
+
+	exp->particles.fresh = h->fresh;
+	exp->particles.h = h->h;
+
+	free(h);
+	exp->checkpoint.state = NULL;
+}
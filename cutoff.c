@@ -0,0 +1,345 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "qsim.h"
+
+/* CU_column: Return the column, or row, of the cells of width (_w) that the coordinate (_u) is in. */
+#define CU_column(_u, _w)  (long long)floorr((_u) / (_w))
+
+/* CU_list: Return the list of (_L) that the cell in column (_cx), row (_cy) and layer (_cz) is wrapped into; (_cz)
+ * is not evaluated in two dimensions. */
+#define CU_wrap(_c, _n)             (int)((((_c) % (_n)) + (_n)) % (_n))
+#define CU_list(_L, _cx, _cy, _cz)  (CU_wrap((_cx), (_L)->columns) + (_L)->columns * (CU_wrap((_cy), (_L)->rows) \
+                                     D3(+ (_L)->rows * CU_wrap((_cz), (_L)->layers))))
+
+/* CU_image: Return the component (_u) of a radius vector, to the nearest image in a periodic box as wide as (_w)
+ * in that direction, if it is not 0. */
+#define CU_image(_u, _w)  ((_w) != 0 ? (_u) - (_w) * floorr((_u) / (_w) + (real)0.5) : (_u))
+
+/* grid: Set the grid of the lists of (exp) for its cutoff, and its box, if it has one; and return the number of
+ * lists, which is never more than (most), that for the same number of objects in open space.
+ */
+static int grid(struct exp *exp, int *most)
+{
+	struct lists *L = &exp->lists;
+	real reach = exp->cutoff * (1 + CU_SKIN);
+
+	/* at least two lists for every object */
+	for (L->columns = 2; L->columns * L->columns D3(* L->columns) < 2 * exp->nobjects; L->columns *= 2)
+		;
+
+	L->rows = L->columns;
+	D3(L->layers = L->columns;)
+	L->width = L->height = D3(L->depth =) reach;
+	*most = L->columns * L->columns D3(* L->columns);
+
+	if (exp->box.x == 0)
+		return *most;
+
+	/* as many cells as fit across the box, and then fewer, wider cells if there are too many */
+	L->columns = exp->box.x / reach < *most ? (int)(exp->box.x / reach) : *most;
+	L->rows = exp->box.y / reach < *most ? (int)(exp->box.y / reach) : *most;
+	D3(L->layers = exp->box.z / reach < *most ? (int)(exp->box.z / reach) : *most;)
+
+	while ((double)L->columns * L->rows D3(* L->layers) > *most)
+		if (L->columns >= L->rows D3(&& L->columns >= L->layers))
+			L->columns = (L->columns + 1) / 2;
+#if DIM == 3
+		else
+		if (L->layers > L->rows)
+			L->layers = (L->layers + 1) / 2;
+#endif
+		else
+			L->rows = (L->rows + 1) / 2;
+
+	L->width = exp->box.x / L->columns;
+	L->height = exp->box.y / L->rows;
+	D3(L->depth = exp->box.z / L->layers;)
+
+	return L->columns * L->rows D3(* L->layers);
+}
+
+/* neighbours: Count the neighbours of the objects from (from) up to (to), in the order of the grid, into the
+ * lists, at (start[i + 1]) for object (i); or, if (fill), write them into the lists from (start[i]). The
+ * neighbours of an object are those within the cutoff and skin in the 3 by 3 (by 3) cells about its own, and are
+ * put in order, so that forces do not depend on the grid.
+ */
+static void neighbours(struct exp *exp, int from, int to, int fill)
+{
+	struct particles *P = &exp->particles;
+	struct lists *L = &exp->lists;
+	real reach = exp->cutoff * (1 + CU_SKIN), rx, ry D3(, rz);
+	long long cx, cy D3(, cz);
+	long k, m, p;
+	int i, j, c, x, y, D3(z,) n, seen[3 D3(* 3) * 3], s;
+
+	reach *= reach;
+
+	for (s = from; s < to; ++s)
+	{
+		i = L->sorted[s];
+		cx = CU_column(P->x[i], L->width), cy = CU_column(P->y[i], L->height);
+		D3(cz = CU_column(P->z[i], L->depth);)
+		m = fill ? L->start[i] : 0;
+		n = 0;
+
+		D3(for (z = -1; z <= 1; ++z))
+		for (y = -1; y <= 1; ++y)
+			for (x = -1; x <= 1; ++x)
+			{
+				/* cells that share a list are only looked through once */
+				for (c = CU_list(L, cx + x, cy + y, cz + z), j = 0; j < n && seen[j] != c; ++j)
+					;
+
+				if (j < n)
+					continue;
+
+				seen[n++] = c;
+
+				for (k = L->cell[c]; k < L->cell[c + 1]; ++k)
+				{
+					j = L->sorted[k];
+					rx = CU_image(P->x[j] - P->x[i], exp->box.x), ry = CU_image(P->y[j] - P->y[i], exp->box.y);
+					D3(rz = CU_image(P->z[j] - P->z[i], exp->box.z);)
+
+					if (j == i || rx * rx + ry * ry D3(+ rz * rz) >= reach)
+						continue;
+
+					if (!fill)
+					{
+						++m;
+
+						continue;
+					}
+
+					/* by insertion, as the objects of each list are already in order */
+					for (p = m++; p > L->start[i] && L->sorted[L->index[p - 1]] > j; --p)
+						L->index[p] = L->index[p - 1];
+
+					L->index[p] = k;
+				}
+			}
+
+		if (!fill)
+			L->start[i + 1] = m;
+	}
+}
+
+static void count(struct exp *exp, int from, int to)
+{
+	neighbours(exp, from, to, 0);
+}
+
+static void fill(struct exp *exp, int from, int to)
+{
+	neighbours(exp, from, to, 1);
+}
+
+/* gather: Copy the locations, charges and masses of the objects from (from) up to (to), in the order of the grid,
+ * to those of the lists.
+ */
+static void gather(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	struct lists *L = &exp->lists;
+	int s, i;
+
+	for (s = from; s < to; ++s)
+	{
+		i = L->sorted[s];
+		L->x[s] = P->x[i], L->y[s] = P->y[i] D3(, L->z[s] = P->z[i]);
+		L->charge[s] = P->charge[i], L->mass[s] = P->mass[i];
+	}
+}
+
+/* moved: Return if an object of (exp) has moved more than half of the skin since the lists were built. */
+static int moved(struct exp *exp)
+{
+	struct particles *P = &exp->particles;
+	struct lists *L = &exp->lists;
+	real half = exp->cutoff * CU_SKIN / 2, dx, dy D3(, dz);
+	int i;
+
+	half *= half;
+
+	for (i = 0; i < exp->nobjects; ++i)
+	{
+		dx = CU_image(P->x[i] - L->x0[i], exp->box.x), dy = CU_image(P->y[i] - L->y0[i], exp->box.y);
+		D3(dz = CU_image(P->z[i] - L->z0[i], exp->box.z);)
+
+		if (dx * dx + dy * dy D3(+ dz * dz) > half)
+			return 1;
+	}
+
+	return 0;
+}
+
+int mklists(struct exp *exp)
+{
+	struct particles *P = &exp->particles;
+	struct lists *L = &exp->lists;
+	long total, size;
+	int i, c, n = exp->nobjects, ncells, most;
+
+	if (L->built && !moved(exp))
+	{
+		parallel(exp, gather);
+
+		return 1;
+	}
+
+	ncells = grid(exp, &most);
+
+	if (L->start == NULL)
+	{
+		if ((L->start = malloc((n + 1) * sizeof(long))) == NULL
+		 || (L->x0 = malloc((2 * DIM + 2) * n * sizeof(real))) == NULL
+		 || (L->sorted = malloc((2 * n + most + 1) * sizeof(int))) == NULL)
+		{
+			warn(WL_crash, "mklists", "malloc returned NULL when attempting allocation of the neighbour lists.\n");
+
+			return 0;
+		}
+
+		L->y0 = L->x0 + n;
+		D3(L->z0 = L->y0 + n;)
+		L->x = L->x0 + DIM * n, L->y = L->x + n;
+		D3(L->z = L->y + n;)
+		L->charge = L->x + DIM * n, L->mass = L->charge + n;
+		L->of = L->sorted + n;
+		L->cell = L->of + n;
+	}
+
+	/* sort the objects into the lists of the grid, in order within each */
+	for (c = 0; c <= ncells; ++c)
+		L->cell[c] = 0;
+
+	for (i = 0; i < n; ++i)
+	{
+		if (!isfinite(P->x[i]) || !isfinite(P->y[i]) D3(|| !isfinite(P->z[i])))
+		{
+			warn(WL_fail, "mklists", "Object %i is not at a finite location.\n", i);
+
+			return 0;
+		}
+
+		++L->cell[(L->of[i] = CU_list(L, CU_column(P->x[i], L->width), CU_column(P->y[i], L->height),
+		                              CU_column(P->z[i], L->depth))) + 1];
+	}
+
+	for (c = 0; c < ncells; ++c)
+		L->cell[c + 1] += L->cell[c];
+
+	for (i = 0; i < n; ++i)
+		L->sorted[L->cell[L->of[i]]++] = i;
+
+	/* each list now begins where the next began */
+	for (c = ncells; c > 0; --c)
+		L->cell[c] = L->cell[c - 1];
+
+	L->cell[0] = 0;
+
+	parallel(exp, count);
+
+	for (i = 0, L->start[0] = 0; i < n; ++i)
+		L->start[i + 1] += L->start[i];
+
+	if ((total = L->start[n]) > L->size)
+	{
+		size = total + total / 4;
+		free(L->index);
+
+		if ((L->index = malloc(size * sizeof(int))) == NULL)
+		{
+			warn(WL_crash, "mklists", "malloc returned NULL when attempting allocation of the neighbour lists.\n");
+			L->size = 0;
+
+			return 0;
+		}
+
+		L->size = size;
+	}
+
+	parallel(exp, fill);
+	parallel(exp, gather);
+
+	for (i = 0; i < n; ++i)
+		L->x0[i] = P->x[i], L->y0[i] = P->y[i] D3(, L->z0[i] = P->z[i]);
+
+	L->built = 1;
+	++L->builds;
+
+	return 1;
+}
+
+/* sum: Calculate the forces on object (i) from its neighbours within the cutoff. */
+static void sum(struct exp *exp, int i)
+{
+	struct particles *P = &exp->particles;
+	struct lists *L = &exp->lists;
+	real xi = P->x[i], yi = P->y[i], rx, ry, rsquared, s, w, q, e2 = exp->softening * exp->softening, c2 = exp->cutoff * exp->cutoff;
+	real l = exp->screening D3(, zi = P->z[i], rz);
+	vector felec = V_make(0,0,0), fgrav = V_make(0,0,0);
+	long k;
+	int j;
+
+	for (k = L->start[i]; k < L->start[i + 1]; ++k)
+	{
+		j = L->index[k];
+		rx = CU_image(L->x[j] - xi, exp->box.x), ry = CU_image(L->y[j] - yi, exp->box.y);
+		D3(rz = CU_image(L->z[j] - zi, exp->box.z);)
+
+		if ((rsquared = rx * rx + ry * ry D3(+ rz * rz)) >= c2)
+			continue;
+
+		/* (w) is 1 / r^3, softened; and (q) that of the electric force, screened by exp(-r / l) (1 + r / l) */
+		rsquared += e2;
+		s = sqrtr(rsquared);
+		w = (real)1 / (rsquared * s);
+		q = l != 0 ? w * expr(-s / l) * (1 + s / l) : w;
+
+		felec.x -= rx * L->charge[j] * q, felec.y -= ry * L->charge[j] * q;
+		fgrav.x += rx * L->mass[j] * w, fgrav.y += ry * L->mass[j] * w;
+		D3(felec.z -= rz * L->charge[j] * q, fgrav.z += rz * L->mass[j] * w;)
+	}
+
+	felec = V_mul(felec, K * P->charge[i]);
+	fgrav = V_mul(fgrav, G * P->mass[i]);
+
+	P->fex[i] = felec.x, P->fey[i] = felec.y D3(, P->fez[i] = felec.z);
+	P->fgx[i] = fgrav.x, P->fgy[i] = fgrav.y D3(, P->fgz[i] = fgrav.z);
+}
+
+void cutoff(struct exp *exp, int from, int to)
+{
+	int i;
+
+	for (i = from; i < to; ++i)
+		sum(exp, i);
+}
+
+void cutoffcells(struct exp *exp, int from, int to)
+{
+	int s;
+
+	for (s = from; s < to; ++s)
+		sum(exp, exp->lists.sorted[s]);
+}
+
+void freelists(struct lists *lists)
+{
+	free(lists->start);
+	free(lists->index);
+	free(lists->x0);
+	free(lists->sorted);
+
+	lists->start = NULL;
+	lists->index = NULL;
+	lists->x0 = lists->y0 = lists->x = lists->y = lists->charge = lists->mass = NULL;
+	D3(lists->z0 = lists->z = NULL;)
+	lists->sorted = lists->of = lists->cell = NULL;
+	lists->size = lists->columns = lists->rows = 0;
+	lists->built = 0;
+}
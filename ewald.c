@@ -0,0 +1,332 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "qsim.h"
+
+/* time of a wave at an object, relative to that of a neighbour, that (ewaldcutoff) balances the sums for */
+#define EW_COST  0.125
+
+/* The waves of the ewald structure (_E) are summed by columns, along their last component (_l); a column is (a), or
+ * (a, b) in three dimensions.
+ * EW_columns: Return the number of columns.
+ * EW_nl: Return the largest last component of the waves.
+ * EW_a, EW_b: Return the components of the column (_col).
+ * EW_zero: Return if (_col) is the column with all but its last component 0, whose waves of (-l) are those of (l)
+ * going the opposite way.
+ * EW_LAST: the last component of a vector.
+ * EW_wave: Return the index of the wave (_l) of the column (_col).
+ * EW_phases: Return the number of reals of the phases of every worker.
+ */
+#if DIM == 3
+#define EW_columns(_E)     (((_E)->na + 1) * (2 * (_E)->nb + 1))
+#define EW_nl(_E)          ((_E)->nc)
+#define EW_a(_E, _col)     ((_col) / (2 * (_E)->nb + 1))
+#define EW_b(_E, _col)     ((_col) % (2 * (_E)->nb + 1) - (_E)->nb)
+#define EW_zero(_E, _col)  ((_col) == (_E)->nb)
+#define EW_LAST            z
+#else
+#define EW_columns(_E)     ((_E)->na + 1)
+#define EW_nl(_E)          ((_E)->nb)
+#define EW_a(_E, _col)     (_col)
+#define EW_zero(_E, _col)  ((_col) == 0)
+#define EW_LAST            y
+#endif
+#define EW_wave(_E, _col, _l)  ((_col) * (2 * EW_nl(_E) + 1) + EW_nl(_E) + (_l))
+#define EW_phases(_E)          (2 * ((_E)->na + (_E)->nb D3(+ (_E)->nc) + DIM))
+
+/* EW_image: Return the component (_u) of a radius vector, to the nearest image in a box as wide as (_w). */
+#define EW_image(_u, _w)  ((_u) - (_w) * floorr((_u) / (_w) + (real)0.5))
+
+/* mkewald: Make the waves of (exp) for its split, cutoff and box, unless they were made for these already; the
+ * Gaussians are as wide as (cutoff / split), so that erfc(split) of a force is left past the cutoff, and the waves
+ * as long as (2 pi / kmax) for kmax = 2 split^2 / cutoff, so that about as much of it is left past them. Returns 0
+ * on failure, and 1 on success.
+ */
+static int mkewald(struct exp *exp)
+{
+	struct ewald *E = &exp->ewald;
+	real kx = 2 * (real)M_PI / exp->box.x, ky = 2 * (real)M_PI / exp->box.y, D3(kz = 2 * (real)M_PI / exp->box.z,) kmax, k;
+	real kl = 2 * (real)M_PI / exp->box.EW_LAST;
+	int a, D3(b,) l, col, nworkers = exp->pool.threads == NULL ? 1 : exp->pool.nthreads;
+
+	if (E->madefor[0] == E->split && E->madefor[1] == exp->cutoff
+	 && E->madefor[2] == exp->box.x && E->madefor[3] == exp->box.y D3(&& E->madefor[4] == exp->box.z)
+	 && E->nworkers >= nworkers)
+		return 1;
+
+	E->alpha = E->split / exp->cutoff;
+	kmax = 2 * E->alpha * E->split;
+	E->na = (int)(kmax / kx);
+	E->nb = (int)(kmax / ky);
+	D3(E->nc = (int)(kmax / kz);)
+	E->nwaves = EW_columns(E) * (2 * EW_nl(E) + 1);
+	E->nworkers = nworkers;
+
+	free(E->weight), free(E->phases), free(E->span);
+
+	/* (weight) owns the memory of (sums) */
+	if ((E->weight = malloc(5 * E->nwaves * sizeof(real))) == NULL
+	 || (E->phases = malloc(nworkers * EW_phases(E) * sizeof(real))) == NULL
+	 || (E->span = malloc(EW_columns(E) * sizeof(int))) == NULL)
+	{
+		warn(WL_crash, "ewald", "malloc returned NULL when attempting allocation of the waves.\n");
+		freeewald(E);
+
+		return 0;
+	}
+
+	E->sums = E->weight + E->nwaves;
+
+	/* the force of every wave is that of its Fourier transform in the plane, 2 pi / k erfc(k / 2 alpha), twice,
+	 * for the wave going the opposite way, over the area of the box; or in space, 4 pi / k^2 exp(-k^2 / 4 alpha^2),
+	 * twice, over its volume. The columns of a = 0 and b < 0 hold only waves going the opposite way of others. */
+	for (col = 0; col < EW_columns(E); ++col)
+		for (E->span[col] = -1, l = -EW_nl(E); l <= EW_nl(E); ++l)
+		{
+			a = EW_a(E, col);
+			D3(b = EW_b(E, col);)
+			k = sqrtr(a * kx * a * kx D3(+ b * ky * b * ky) + l * kl * l * kl);
+
+			if ((EW_zero(E, col) && l <= 0) D3(|| (a == 0 && b < 0)) || k > kmax)
+				E->weight[EW_wave(E, col, l)] = 0;
+			else
+#if DIM == 3
+				E->weight[EW_wave(E, col, l)] = 8 * (real)M_PI * expr(-k * k / (4 * E->alpha * E->alpha))
+				                              / (exp->box.x * exp->box.y * exp->box.z * k * k),
+#else
+				E->weight[EW_wave(E, col, l)] = 4 * (real)M_PI * erfcr(k / (2 * E->alpha)) / (exp->box.x * exp->box.y * k),
+#endif
+				E->span[col] = l;
+		}
+
+	E->madefor[0] = E->split, E->madefor[1] = exp->cutoff;
+	E->madefor[2] = exp->box.x, E->madefor[3] = exp->box.y;
+	D3(E->madefor[4] = exp->box.z;)
+
+	return 1;
+}
+
+/* phase: Fill (px) with the phases exp(i 2 pi a x / box.x) of the location (x, y (, z)), from a = (from) up to (to),
+ * and (py) with exp(i 2 pi b y / box.y), from b = 0 up to (nb), (and (pz) with exp(i 2 pi c z / box.z), from c = 0 up
+ * to (nc)); each as its real part followed by its imaginary part.
+ */
+static void phase(struct exp *exp, real x, real y, D3(real z,) int from, int to, real *px, real *py D3(, real *pz))
+{
+	real t = 2 * (real)M_PI * x / exp->box.x, c = cosr(t), s = sinr(t);
+	int a, b;
+
+	px[2 * from] = cosr(t * from), px[2 * from + 1] = sinr(t * from);
+
+	for (a = from + 1; a < to; ++a)
+	{
+		px[2 * a] = px[2 * a - 2] * c - px[2 * a - 1] * s;
+		px[2 * a + 1] = px[2 * a - 2] * s + px[2 * a - 1] * c;
+	}
+
+	t = 2 * (real)M_PI * y / exp->box.y, c = cosr(t), s = sinr(t);
+	py[0] = 1, py[1] = 0;
+
+	for (b = 1; b <= exp->ewald.nb; ++b)
+	{
+		py[2 * b] = py[2 * b - 2] * c - py[2 * b - 1] * s;
+		py[2 * b + 1] = py[2 * b - 2] * s + py[2 * b - 1] * c;
+	}
+
+#if DIM == 3
+	t = 2 * (real)M_PI * z / exp->box.z, c = cosr(t), s = sinr(t);
+	pz[0] = 1, pz[1] = 0;
+
+	for (b = 1; b <= exp->ewald.nc; ++b)
+	{
+		pz[2 * b] = pz[2 * b - 2] * c - pz[2 * b - 1] * s;
+		pz[2 * b + 1] = pz[2 * b - 2] * s + pz[2 * b - 1] * c;
+	}
+#endif
+}
+
+/* column: Set (cx, sx) to the phase exp(i 2 pi (a x / box.x + b y / box.y)) of the column (col) at the location whose
+ * phases (px, py) were filled by (phase); that is, (px[a]) in two dimensions. The column of b < 0 is that of the
+ * conjugate of exp(i 2 pi |b| y / box.y).
+ */
+static void column(struct ewald *E, int col, const real *px, const real *py, real *cx, real *sx)
+{
+	int a = EW_a(E, col);
+
+	*cx = px[2 * a], *sx = px[2 * a + 1];
+
+#if DIM == 3
+	real c = *cx, s = *sx, cy, sy;
+	int b = EW_b(E, col);
+
+	cy = py[2 * abs(b)], sy = b < 0 ? -py[2 * abs(b) + 1] : py[2 * abs(b) + 1];
+	*cx = c * cy - s * sy, *sx = s * cy + c * sy;
+#else
+	(void)E, (void)py;
+#endif
+}
+
+/* waves: Sum the charges and masses of every object, times the cosine and the sine of the phase of every wave at
+ * it, for the waves of the columns given to (worker); every object is summed in order, and its phases are always
+ * stepped from a = 0, as in (apply), so that the sums do not depend on the number of workers.
+ */
+static void waves(struct exp *exp, int worker, int nworkers)
+{
+	struct particles *P = &exp->particles;
+	struct ewald *E = &exp->ewald;
+	real *px = E->phases + worker * EW_phases(E), *py = px + 2 * (E->na + 1), *pl = py D3(+ 2 * (E->nb + 1)), *sum, c, s;
+	real cx, sx, cl, sl, q, m;
+	int from = EW_columns(E) * worker / nworkers, to = EW_columns(E) * (worker + 1) / nworkers, col, l, i, w;
+
+	for (w = EW_wave(E, from, -EW_nl(E)); w < EW_wave(E, to, -EW_nl(E)); ++w)
+		E->sums[4 * w] = E->sums[4 * w + 1] = E->sums[4 * w + 2] = E->sums[4 * w + 3] = 0;
+
+	for (i = 0; i < exp->nobjects && from < to; ++i)
+	{
+		phase(exp, P->x[i], P->y[i], D3(P->z[i],) 0, EW_a(E, to - 1) + 1, px, py D3(, pl));
+		q = P->charge[i], m = P->mass[i];
+
+		for (col = from; col < to; ++col)
+		{
+			column(E, col, px, py, &cx, &sx);
+
+			for (l = EW_zero(E, col) ? 1 : 0; l <= E->span[col]; ++l)
+			{
+				/* exp(i (a x + l y)), and then exp(i (a x - l y)), as exp(-i l y) is the conjugate of exp(i l y);
+				 * with (l z) for (l y), and the column for (a x), in three dimensions */
+				cl = pl[2 * l], sl = pl[2 * l + 1];
+				c = cx * cl - sx * sl, s = sx * cl + cx * sl;
+				sum = &E->sums[4 * EW_wave(E, col, l)];
+				sum[0] += q * c, sum[1] += q * s, sum[2] += m * c, sum[3] += m * s;
+
+				if (EW_zero(E, col) || l == 0)
+					continue;
+
+				c = cx * cl + sx * sl, s = sx * cl - cx * sl;
+				sum = &E->sums[4 * EW_wave(E, col, -l)];
+				sum[0] += q * c, sum[1] += q * s, sum[2] += m * c, sum[3] += m * s;
+			}
+		}
+	}
+}
+
+/* apply: Calculate the forces on the objects given to (worker), in the order of the grid of the lists: those of
+ * their neighbours within the cutoff, which fall off as erfc(alpha r), and those of the waves.
+ */
+static void apply(struct exp *exp, int worker, int nworkers)
+{
+	struct particles *P = &exp->particles;
+	struct lists *L = &exp->lists;
+	struct ewald *E = &exp->ewald;
+	real *px = E->phases + worker * EW_phases(E), *py = px + 2 * (E->na + 1), *pl = py D3(+ 2 * (E->nb + 1)), *sum;
+	real rx, ry, D3(rz,) rsquared, r, w, c, s, t, cx, sx, cl, sl;
+	real kx = 2 * (real)M_PI / exp->box.x, D3(ky = 2 * (real)M_PI / exp->box.y,) kl = 2 * (real)M_PI / exp->box.EW_LAST;
+	real e2 = exp->softening * exp->softening, c2 = exp->cutoff * exp->cutoff, alpha = E->alpha;
+	vector felec, fgrav;
+	long k;
+	int from = (int)((long)exp->nobjects * worker / nworkers), to = (int)((long)exp->nobjects * (worker + 1) / nworkers);
+	int a, D3(b,) l, col, i, j, n, v;
+
+	for (n = from; n < to; ++n)
+	{
+		i = L->sorted[n];
+		felec = V_make(0,0,0);
+		fgrav = V_make(0,0,0);
+
+		for (k = L->start[i]; k < L->start[i + 1]; ++k)
+		{
+			j = L->index[k];
+			rx = EW_image(L->x[j] - P->x[i], exp->box.x), ry = EW_image(L->y[j] - P->y[i], exp->box.y);
+			D3(rz = EW_image(L->z[j] - P->z[i], exp->box.z);)
+
+			if ((rsquared = rx * rx + ry * ry D3(+ rz * rz)) >= c2)
+				continue;
+
+			/* (w) is that of the force of erfc(alpha r) / r, softened */
+			rsquared += e2;
+			r = sqrtr(rsquared);
+			w = (erfcr(alpha * r) / r + (real)M_2_SQRTPI * alpha * expr(-alpha * alpha * rsquared)) / rsquared;
+
+			felec.x -= rx * L->charge[j] * w, felec.y -= ry * L->charge[j] * w;
+			fgrav.x += rx * L->mass[j] * w, fgrav.y += ry * L->mass[j] * w;
+			D3(felec.z -= rz * L->charge[j] * w, fgrav.z += rz * L->mass[j] * w;)
+		}
+
+		phase(exp, P->x[i], P->y[i], D3(P->z[i],) 0, E->na + 1, px, py D3(, pl));
+
+		/* the sine of the phase of every wave from every object to this one, as in (waves); like charges repel,
+		 * and masses attract */
+		for (col = 0; col < EW_columns(E); ++col)
+		{
+			column(E, col, px, py, &cx, &sx);
+			a = EW_a(E, col);
+			D3(b = EW_b(E, col);)
+
+			for (l = EW_zero(E, col) ? 1 : 0; l <= E->span[col]; ++l)
+			{
+				cl = pl[2 * l], sl = pl[2 * l + 1];
+				c = cx * cl - sx * sl, s = sx * cl + cx * sl;
+				v = EW_wave(E, col, l), sum = &E->sums[4 * v];
+				t = E->weight[v] * (s * sum[0] - c * sum[1]);
+				felec.x += t * a * kx, D3(felec.y += t * b * ky,) felec.EW_LAST += t * l * kl;
+				t = E->weight[v] * (s * sum[2] - c * sum[3]);
+				fgrav.x -= t * a * kx, D3(fgrav.y -= t * b * ky,) fgrav.EW_LAST -= t * l * kl;
+
+				if (EW_zero(E, col) || l == 0)
+					continue;
+
+				c = cx * cl + sx * sl, s = sx * cl - cx * sl;
+				v = EW_wave(E, col, -l), sum = &E->sums[4 * v];
+				t = E->weight[v] * (s * sum[0] - c * sum[1]);
+				felec.x += t * a * kx, D3(felec.y += t * b * ky,) felec.EW_LAST -= t * l * kl;
+				t = E->weight[v] * (s * sum[2] - c * sum[3]);
+				fgrav.x -= t * a * kx, D3(fgrav.y -= t * b * ky,) fgrav.EW_LAST += t * l * kl;
+			}
+		}
+
+		felec = V_mul(felec, K * P->charge[i]);
+		fgrav = V_mul(fgrav, G * P->mass[i]);
+
+		P->fex[i] = felec.x, P->fey[i] = felec.y D3(, P->fez[i] = felec.z);
+		P->fgx[i] = fgrav.x, P->fgy[i] = fgrav.y D3(, P->fgz[i] = fgrav.z);
+	}
+}
+
+int ewald(struct exp *exp)
+{
+	if (!mkewald(exp) || !mklists(exp))
+		return 0;
+
+	/* every wave is summed over every object before any force is */
+	everyworker(exp, waves);
+	everyworker(exp, apply);
+
+	return 1;
+}
+
+real ewaldcutoff(struct exp *exp)
+{
+#if DIM == 3
+	/* the neighbours of an object grow as n 4 pi r^3 / 3 V, and the waves as 2 split^6 V / 3 pi^2 r^3 */
+	real volume = exp->box.x * exp->box.y * exp->box.z, most = V_least(exp->box) / (2 * (1 + CU_SKIN));
+	real r = (real)EW_SPLIT * powr(volume, (real)1 / 3)
+	       * powr((real)EW_COST / (2 * (real)M_PI * (real)M_PI * (real)M_PI * exp->nobjects), (real)1 / 6);
+#else
+	/* the neighbours of an object grow as n pi r^2 / A, and the waves as split^4 A / 2 pi r^2 */
+	real area = exp->box.x * exp->box.y, most = V_least(exp->box) / (2 * (1 + CU_SKIN));
+	real r = (real)EW_SPLIT * sqrtr(area) * powr((real)EW_COST / (2 * (real)M_PI * (real)M_PI * exp->nobjects), (real)0.25);
+#endif
+
+	return r < most ? r : most;
+}
+
+void freeewald(struct ewald *ewald)
+{
+	free(ewald->weight), free(ewald->phases), free(ewald->span);
+
+	ewald->weight = ewald->sums = ewald->phases = NULL;
+	ewald->span = NULL;
+	ewald->nworkers = 0;
+	ewald->madefor[0] = -1;
+}
@@ -0,0 +1,617 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "qsim.h"
+
+#define FMM_LEAFSIZE   32  /* objects per leaf, on average, that the level of the leaves is chosen for */
+#define FMM_MINLEVELS  2   /* boxes are first well-separated at level 2 */
+#define FMM_SPAN       7   /* offsets of an interaction list are from -3 up to 3 boxes, in each direction */
+#define FMM_NCHILD     (1 << DIM)  /* quadrants of a box; octants in three dimensions */
+
+#if DIM == 3
+#define FMM_MAXLEVELS  6   /* level of the leaves at most */
+#else
+#define FMM_MAXLEVELS  10
+#endif
+
+/* coefficients of an expansion of degree (_d), and the index of the coefficient of x^(_a) y^(_b) (z^(_c)) in one;
+ * in order of degree, and then of (_b) and (_c) as in two dimensions. (_c) is not evaluated in two dimensions. */
+#if DIM == 3
+#define FMM_ncoef(_d)          (((_d) + 1) * ((_d) + 2) * ((_d) + 3) / 6)
+#define FMM_index(_a, _b, _c)  (FMM_ncoef((_a) + (_b) + (_c) - 1) + ((_b) + (_c)) * ((_b) + (_c) + 1) / 2 + (_c))
+#else
+#define FMM_ncoef(_d)          (((_d) + 1) * ((_d) + 2) / 2)
+#define FMM_index(_a, _b, _c)  (((_a) + (_b)) * ((_a) + (_b) + 1) / 2 + (_b))
+#endif
+
+/* exponents of x, y (and z) of the coefficient (_k), and its degree */
+#define FMM_exponents(_fmm, _k)  (&(_fmm)->exponents[DIM * (_k)])
+#define FMM_degree(_e)           ((_e)[0] + (_e)[1] D3(+ (_e)[2]))
+
+/* first box of level (_l) among the boxes of every level */
+#define FMM_first(_l)  (((1 << DIM * (_l)) - 1) / (FMM_NCHILD - 1))
+
+/* derivatives at the offset (_x, _y, _z), in boxes, from the source of an interaction to its target */
+#define FMM_derivs(_fmm, _x, _y, _z)  \
+	(&(_fmm)->derivs[((D3(((_z) + FMM_SPAN / 2) * FMM_SPAN +) (_y) + FMM_SPAN / 2) * FMM_SPAN + (_x) + FMM_SPAN / 2) \
+	                 * (_fmm)->ncoef])
+
+/* spread: Return (x) with a 0 bit inserted after each of its bits; or two, in three dimensions.
+ * gather: Return every other bit of (x), or every third; the inverse of (spread).
+ */
+#if DIM == 3
+static int spread(int x)
+{
+	x = (x | x << 16) & 0x030000ff;
+	x = (x | x << 8) & 0x0300f00f;
+	x = (x | x << 4) & 0x030c30c3;
+	x = (x | x << 2) & 0x09249249;
+
+	return x;
+}
+
+static int gather(int x)
+{
+	x &= 0x09249249;
+	x = (x | x >> 2) & 0x030c30c3;
+	x = (x | x >> 4) & 0x0300f00f;
+	x = (x | x >> 8) & 0x030000ff;
+	x = (x | x >> 16) & 0x000003ff;
+
+	return x;
+}
+#else
+static int spread(int x)
+{
+	x = (x | x << 8) & 0x00ff00ff;
+	x = (x | x << 4) & 0x0f0f0f0f;
+	x = (x | x << 2) & 0x33333333;
+	x = (x | x << 1) & 0x55555555;
+
+	return x;
+}
+
+static int gather(int x)
+{
+	x &= 0x55555555;
+	x = (x | x >> 1) & 0x33333333;
+	x = (x | x >> 2) & 0x0f0f0f0f;
+	x = (x | x >> 4) & 0x00ff00ff;
+	x = (x | x >> 8) & 0x0000ffff;
+
+	return x;
+}
+#endif
+
+/* box of the column (_x), row (_y) (and layer (_z)) of its level; its quadrant in its parent is then as in
+ * (BH_quadrant) */
+#define FMM_box(_x, _y, _z)  (spread(_x) | spread(_y) << 1 D3(| spread(_z) << 2))
+
+/* binomial: Return the binomial coefficient of (n) choose (k). */
+static real binomial(int n, int k)
+{
+	real r = 1;
+	int i;
+
+	for (i = 1; i <= k; ++i)
+		r = r * (n - k + i) / i;
+
+	return r;
+}
+
+/* derivatives: Fill (d) with the derivatives of 1 / r at (x, y (, z)), up to degree (degree), each over the
+ * factorial of its multi-index; by the recurrence n r^2 d(a,b) = -(2n - 1) (x d(a-1,b) + y d(a,b-1)) - (n - 1)
+ * (d(a-2,b) + d(a,b-2)), with n = a + b, and likewise along z in three dimensions.
+ */
+static void derivatives(struct fmm *fmm, real x, real y, D3(real z,) int degree, real *d)
+{
+	real rsquared = x * x + y * y D3(+ z * z), sum;
+	int *e, n, k, a, b D3(, c);
+
+	d[0] = 1 / sqrtr(rsquared);
+
+	for (k = 1; k < FMM_ncoef(degree); ++k)
+	{
+		e = FMM_exponents(fmm, k);
+		a = e[0], b = e[1];
+		D3(c = e[2];)
+		n = FMM_degree(e);
+		sum = (real)0;
+
+		if (a >= 1)
+			sum += (2 * n - 1) * x * d[FMM_index(a - 1, b, c)];
+
+		if (b >= 1)
+			sum += (2 * n - 1) * y * d[FMM_index(a, b - 1, c)];
+
+#if DIM == 3
+		if (c >= 1)
+			sum += (2 * n - 1) * z * d[FMM_index(a, b, c - 1)];
+#endif
+
+		if (a >= 2)
+			sum += (n - 1) * d[FMM_index(a - 2, b, c)];
+
+		if (b >= 2)
+			sum += (n - 1) * d[FMM_index(a, b - 2, c)];
+
+#if DIM == 3
+		if (c >= 2)
+			sum += (n - 1) * d[FMM_index(a, b, c - 2)];
+#endif
+
+		d[k] = -sum / (n * rsquared);
+	}
+}
+
+/* mkoperators: Make the operators of (fmm) for the order (order), and allocate its expansions. Returns 0 on
+ * failure, and 1 on success.
+ *
+ * With the offset (h) of an object from the center of its box in units of the box's width w, a box's multipole
+ * coefficients are M(a) = sum of q h^a over its objects, and the potential at an offset (D) from it, well
+ * outside it, is (1 / w) sum of (-1)^|a| M(a) d(a)(D), to |a| <= order. A local expansion about a box holds the
+ * potential at an offset (h) inside it as (1 / w) sum of L(c) h^c, to |c| <= order + 1.
+ */
+static int mkoperators(struct fmm *fmm, int order)
+{
+	int nm = FMM_ncoef(order), nl = FMM_ncoef(order + 1), nboxes = FMM_first(fmm->levels + 1);
+	int q, x, y, D3(z,) n, m, a, b, D3(c,) k, j, nterms, *e, *f;
+	real *m2m, *l2l, *derivs, dx, dy D3(, dz);
+	struct term *terms;
+
+	fmm->ncoef = nl;
+
+	free(fmm->m2m), free(fmm->l2l), free(fmm->derivs), free(fmm->terms), free(fmm->exponents);
+	free(fmm->multipole), free(fmm->local);
+	fmm->order = -1;
+	fmm->m2m = fmm->l2l = fmm->derivs = fmm->multipole = fmm->local = NULL;
+	fmm->terms = NULL;
+
+	/* the exponents of every coefficient, in the order of (FMM_index) */
+	if ((fmm->exponents = malloc(DIM * nl * sizeof(int))) == NULL)
+		return 0;
+
+	for (k = 0, n = 0; n <= order + 1; ++n)
+		for (m = 0; m <= n; ++m)
+		{
+#if DIM == 3
+			for (c = 0; c <= m; ++c, ++k)
+				e = FMM_exponents(fmm, k), e[0] = n - m, e[1] = m - c, e[2] = c;
+#else
+			e = FMM_exponents(fmm, k++), e[0] = n - m, e[1] = m;
+#endif
+		}
+
+	for (nterms = 0, k = 0; k < nm; ++k)
+		nterms += FMM_ncoef(order + 1 - FMM_degree(FMM_exponents(fmm, k)));
+
+	fmm->m2m = m2m = calloc(FMM_NCHILD * nm * nm, sizeof(real));
+	fmm->l2l = l2l = calloc(FMM_NCHILD * nl * nl, sizeof(real));
+	fmm->derivs = derivs = calloc(FMM_SPAN * FMM_SPAN D3(* FMM_SPAN) * nl, sizeof(real));
+	fmm->terms = terms = malloc(nterms * sizeof(struct term));
+	fmm->multipole = malloc((size_t)nboxes * 2 * nl * sizeof(real));
+	fmm->local = malloc((size_t)nboxes * 2 * nl * sizeof(real));
+
+	if (m2m == NULL || l2l == NULL || derivs == NULL || terms == NULL || fmm->multipole == NULL || fmm->local == NULL)
+		return 0;
+
+	/* The center of quadrant (q) is a quarter of its parent's width from the parent's center in each direction;
+	 * the expansions of a quadrant are in units of half the width of those of its parent. */
+	for (q = 0; q < FMM_NCHILD; ++q, m2m += nm * nm, l2l += nl * nl)
+	{
+		dx = q & 1 ? (real)0.25 : (real)-0.25;
+		dy = q & 2 ? (real)0.25 : (real)-0.25;
+		D3(dz = q & 4 ? (real)0.25 : (real)-0.25;)
+
+		/* M(a) of the parent is the sum of C(a, x) d^(a - x) M(x) / 2^|x| of the quadrant, for x <= a */
+		for (k = 0; k < nm; ++k)
+			for (j = 0; j <= k; ++j)
+			{
+				e = FMM_exponents(fmm, k), f = FMM_exponents(fmm, j);
+				a = e[0], b = e[1], x = f[0], y = f[1];
+				D3(c = e[2], z = f[2];)
+
+				if (x > a || y > b D3(|| z > c))
+					continue;
+
+				m2m[k * nm + j] = binomial(a, x) * binomial(b, y) D3(* binomial(c, z))
+				                * powr(dx, a - x) * powr(dy, b - y) D3(* powr(dz, c - z)) / powr(2, FMM_degree(f));
+			}
+
+		/* L(c) of the quadrant is the sum of C(x, c) d^(x - c) L(x) / 2^(|c| + 1) of the parent, for x >= c */
+		for (k = 0; k < nl; ++k)
+			for (j = k; j < nl; ++j)
+			{
+				e = FMM_exponents(fmm, k), f = FMM_exponents(fmm, j);
+				a = e[0], b = e[1], x = f[0], y = f[1];
+				D3(c = e[2], z = f[2];)
+
+				if (x < a || y < b D3(|| z < c))
+					continue;
+
+				l2l[k * nl + j] = binomial(x, a) * binomial(y, b) D3(* binomial(z, c))
+				                * powr(dx, x - a) * powr(dy, y - b) D3(* powr(dz, z - c)) / powr(2, FMM_degree(e) + 1);
+			}
+	}
+
+	/* the offsets of an interaction list are whole numbers of boxes, so their derivatives are the same on every level */
+	D3(for (z = -FMM_SPAN / 2; z <= FMM_SPAN / 2; ++z))
+	for (y = -FMM_SPAN / 2; y <= FMM_SPAN / 2; ++y)
+		for (x = -FMM_SPAN / 2; x <= FMM_SPAN / 2; ++x)
+			if (abs(x) > 1 || abs(y) > 1 D3(|| abs(z) > 1))
+				derivatives(fmm, x, y, D3(z,) order + 1, FMM_derivs(fmm, x, y, z));
+
+	/* L(c) is the sum of (-1)^|a| C(a + c, a) M(a) d(a + c)(D), for |a| <= order and |a + c| <= order + 1 */
+	fmm->nterms = 0;
+
+	for (k = 0; k < nm; ++k)
+		for (e = FMM_exponents(fmm, k), j = 0; j < FMM_ncoef(order + 1 - FMM_degree(e)); ++j)
+		{
+			f = FMM_exponents(fmm, j);
+			terms->l = j;
+			terms->m = k;
+			terms->d = FMM_index(e[0] + f[0], e[1] + f[1], e[2] + f[2]);
+			terms->c = (FMM_degree(e) % 2 ? -1 : 1) * binomial(e[0] + f[0], e[0]) * binomial(e[1] + f[1], e[1])
+			           D3(* binomial(e[2] + f[2], e[2]));
+			++terms, ++fmm->nterms;
+		}
+
+	fmm->order = order;
+
+	return 1;
+}
+
+/* mkfmm: Sort the objects of (exp) into the leaves of its fmm structure, allocating it and making its operators if
+ * this has not yet been done for its order. Returns 0 on failure, and 1 on success.
+ */
+static int mkfmm(struct exp *exp)
+{
+	struct fmm *fmm = &exp->fmm;
+	struct particles *P = &exp->particles;
+	vector min, max;
+	real width;
+	int i, k, x, y, D3(z,) side, nleaves, n = exp->nobjects;
+
+	if (fmm->start == NULL)
+	{
+		/* leaves of about (FMM_LEAFSIZE) objects each, if the objects were spread evenly */
+		for (fmm->levels = FMM_MINLEVELS; fmm->levels < FMM_MAXLEVELS && (long)FMM_LEAFSIZE << DIM * fmm->levels < n; )
+			++fmm->levels;
+
+		if ((fmm->start = malloc(((1 << DIM * fmm->levels) + 1) * sizeof(int))) == NULL
+		 || (fmm->index = malloc(2 * n * sizeof(int))) == NULL
+		 || (fmm->x = malloc((DIM + 2) * n * sizeof(real))) == NULL)
+			goto mkfmm_fail;
+
+		/* (index) and (x) own the memory of (leaf), and of the other sorted arrays */
+		fmm->leaf = fmm->index + n;
+		fmm->y = fmm->x + n;
+		D3(fmm->z = fmm->y + n;)
+		fmm->charge = fmm->x + DIM * n;
+		fmm->mass = fmm->charge + n;
+	}
+
+	if (fmm->order != exp->order && !mkoperators(fmm, exp->order))
+		goto mkfmm_fail;
+
+	/* bounds of the root box */
+	min = max = V_make(P->x[0], P->y[0], P->z[0]);
+
+	for (i = 1; i < n; ++i)
+	{
+		min.x = P->x[i] < min.x ? P->x[i] : min.x;
+		min.y = P->y[i] < min.y ? P->y[i] : min.y;
+		max.x = P->x[i] > max.x ? P->x[i] : max.x;
+		max.y = P->y[i] > max.y ? P->y[i] : max.y;
+		D3(min.z = P->z[i] < min.z ? P->z[i] : min.z;)
+		D3(max.z = P->z[i] > max.z ? P->z[i] : max.z;)
+	}
+
+	width = max.x - min.x > max.y - min.y ? max.x - min.x : max.y - min.y;
+	D3(width = max.z - min.z > width ? max.z - min.z : width;)
+	width *= (real)1.0001;
+
+	if (width == (real)0)
+		width = (real)1;
+
+	fmm->min = min;
+	fmm->width = width;
+
+	/* count the objects of every leaf, so that (start) is the end of every leaf; then place each object at the
+	 * end of its leaf, which moves (start) back to the beginning of every leaf */
+	side = 1 << fmm->levels;
+	nleaves = side * side D3(* side);
+	memset(fmm->start, 0, (nleaves + 1) * sizeof(int));
+
+	for (i = 0; i < n; ++i)
+	{
+		x = (int)((P->x[i] - min.x) / width * side);
+		y = (int)((P->y[i] - min.y) / width * side);
+		x = x < 0 ? 0 : x >= side ? side - 1 : x;
+		y = y < 0 ? 0 : y >= side ? side - 1 : y;
+#if DIM == 3
+		z = (int)((P->z[i] - min.z) / width * side);
+		z = z < 0 ? 0 : z >= side ? side - 1 : z;
+#endif
+
+		fmm->leaf[i] = FMM_box(x, y, z);
+		++fmm->start[fmm->leaf[i]];
+	}
+
+	for (k = 0; k < nleaves; ++k)
+		fmm->start[k + 1] += fmm->start[k];
+
+	for (i = n - 1; i >= 0; --i)
+	{
+		k = --fmm->start[fmm->leaf[i]];
+
+		fmm->index[k] = i;
+		fmm->x[k] = P->x[i];
+		fmm->y[k] = P->y[i];
+		D3(fmm->z[k] = P->z[i];)
+		fmm->charge[k] = P->charge[i];
+		fmm->mass[k] = P->mass[i];
+	}
+
+	return 1;
+
+mkfmm_fail:
+	warn(WL_crash, "mkfmm", "(malloc|calloc) returned NULL when attempting allocation of the fmm structure.\n");
+	freefmm(fmm);
+
+	return 0;
+}
+
+/* boxes of level (_l) that worker (_w) of (_n) works over, beginning from box (_b) */
+#define FMM_boxes(_l, _w, _n, _b)  ((_b) = (int)((long)(1 << DIM * (_l)) * (_w) / (_n)), \
+                                   (int)((long)(1 << DIM * (_l)) * ((_w) + 1) / (_n)))
+
+/* first and end in the sorted objects of the objects of box (_b) of level (_l) */
+#define FMM_begin(_fmm, _l, _b)  ((_fmm)->start[(_b) << DIM * ((_fmm)->levels - (_l))])
+#define FMM_end(_fmm, _l, _b)    ((_fmm)->start[((_b) + 1) << DIM * ((_fmm)->levels - (_l))])
+
+/* upward: Make the multipole expansions of the boxes of level (level) of (fmm) that this worker works over; of
+ * the objects of each leaf, or of the expansions of the quadrants of each box above them.
+ */
+static void upward(struct exp *exp, int worker, int nworkers)
+{
+	struct fmm *fmm = &exp->fmm;
+	int l = fmm->level, nm = FMM_ncoef(fmm->order), nc = fmm->ncoef;
+	int b, end, q, k, i, j, *e;
+	real *M, *child, *op, w = fmm->width / (1 << l), hx[FMM_MAXORDER + 1], hy[FMM_MAXORDER + 1], sq, sm;
+	D3(real hz[FMM_MAXORDER + 1];)
+	vector center;
+
+	for (end = FMM_boxes(l, worker, nworkers, b); b < end; ++b)
+	{
+		M = &fmm->multipole[(FMM_first(l) + b) * 2 * nc];
+
+		for (k = 0; k < nm; ++k)
+			M[k] = M[nc + k] = (real)0;
+
+		if (FMM_begin(fmm, l, b) == FMM_end(fmm, l, b))
+			continue;
+
+		if (l < fmm->levels)
+		/* sum the expansions of the quadrants, each moved to the center of this box */
+		{
+			for (q = 0; q < FMM_NCHILD; ++q)
+			{
+				if (FMM_begin(fmm, l + 1, (b << DIM) + q) == FMM_end(fmm, l + 1, (b << DIM) + q))
+					continue;
+
+				child = &fmm->multipole[(FMM_first(l + 1) + (b << DIM) + q) * 2 * nc];
+				op = &fmm->m2m[q * nm * nm];
+
+				for (k = 0; k < nm; ++k)
+					for (j = 0; j <= k; ++j)
+						M[k] += op[k * nm + j] * child[j], M[nc + k] += op[k * nm + j] * child[nc + j];
+			}
+
+			continue;
+		}
+
+		/* sum the objects of this leaf */
+		center = V_make(fmm->min.x + (gather(b) + (real)0.5) * w, fmm->min.y + (gather(b >> 1) + (real)0.5) * w,
+		                fmm->min.z + (gather(b >> 2) + (real)0.5) * w);
+
+		for (i = FMM_begin(fmm, l, b); i < FMM_end(fmm, l, b); ++i)
+		{
+			hx[0] = hy[0] = (real)1;
+			hx[1] = (fmm->x[i] - center.x) / w;
+			hy[1] = (fmm->y[i] - center.y) / w;
+			D3(hz[0] = (real)1, hz[1] = (fmm->z[i] - center.z) / w;)
+
+			for (k = 2; k <= fmm->order; ++k)
+				hx[k] = hx[k - 1] * hx[1], hy[k] = hy[k - 1] * hy[1] D3(, hz[k] = hz[k - 1] * hz[1]);
+
+			for (k = 0; k < nm; ++k)
+			{
+				e = FMM_exponents(fmm, k);
+				sq = fmm->charge[i] * hx[e[0]] * hy[e[1]] D3(* hz[e[2]]);
+				sm = fmm->mass[i] * hx[e[0]] * hy[e[1]] D3(* hz[e[2]]);
+				M[k] += sq;
+				M[nc + k] += sm;
+			}
+		}
+	}
+}
+
+/* downward: Make the local expansions of the boxes of level (level) of (fmm) that this worker works over; from
+ * the local expansion of each box's parent, and the multipole expansions of the boxes of its interaction list.
+ * On the level of the leaves, the forces on their objects are then calculated from these, and from the objects
+ * of the neighbouring leaves.
+ */
+static void downward(struct exp *exp, int worker, int nworkers)
+{
+	struct fmm *fmm = &exp->fmm;
+	struct particles *P = &exp->particles;
+	struct term *term, *terms = fmm->terms + fmm->nterms;
+	int l = fmm->level, nc = fmm->ncoef, side = 1 << l, order = fmm->order;
+	int b, end, k, j, i, a, D3(c,) x, y, D3(z, sz, nz,) sx, sy, s, nx, ny, *e;
+	real *L, *parent, *M, *d, *op, w = fmm->width / side, hx[FMM_MAXORDER + 2], hy[FMM_MAXORDER + 2];
+	real rx, ry, D3(rz, hz[FMM_MAXORDER + 2],) rsquared, r3, e2 = exp->softening * exp->softening;
+	vector center, qpull, mpull;
+
+	for (end = FMM_boxes(l, worker, nworkers, b); b < end; ++b)
+	{
+		if (FMM_begin(fmm, l, b) == FMM_end(fmm, l, b))
+			continue;
+
+		L = &fmm->local[(FMM_first(l) + b) * 2 * nc];
+
+		for (k = 0; k < nc; ++k)
+			L[k] = L[nc + k] = (real)0;
+
+		if (l > FMM_MINLEVELS)
+		/* the local expansion of the parent, moved to the center of this box */
+		{
+			parent = &fmm->local[(FMM_first(l - 1) + (b >> DIM)) * 2 * nc];
+			op = &fmm->l2l[(b & (FMM_NCHILD - 1)) * nc * nc];
+
+			for (k = 0; k < nc; ++k)
+				for (j = k; j < nc; ++j)
+					L[k] += op[k * nc + j] * parent[j], L[nc + k] += op[k * nc + j] * parent[nc + j];
+		}
+
+		/* The interaction list is of the quadrants of the parent's neighbours that are not neighbours of this box;
+		 * the parent's neighbours' other quadrants are summed by the parent, and those of its ancestors. */
+		x = gather(b), y = gather(b >> 1);
+		D3(z = gather(b >> 2);)
+
+		D3(for (nz = (z >> 1) - 1; nz <= (z >> 1) + 1; ++nz))
+		for (ny = (y >> 1) - 1; ny <= (y >> 1) + 1; ++ny)
+			for (nx = (x >> 1) - 1; nx <= (x >> 1) + 1; ++nx)
+			{
+				if (nx < 0 || ny < 0 || 2 * nx >= side || 2 * ny >= side D3(|| nz < 0 || 2 * nz >= side))
+					continue;
+
+				for (k = 0; k < FMM_NCHILD; ++k)
+				{
+					sx = 2 * nx + (k & 1), sy = 2 * ny + (k >> 1 & 1);
+					D3(sz = 2 * nz + (k >> 2);)
+					s = FMM_box(sx, sy, sz);
+
+					if ((abs(sx - x) <= 1 && abs(sy - y) <= 1 D3(&& abs(sz - z) <= 1))
+					 || FMM_begin(fmm, l, s) == FMM_end(fmm, l, s))
+						continue;
+
+					M = &fmm->multipole[(FMM_first(l) + s) * 2 * nc];
+					d = FMM_derivs(fmm, x - sx, y - sy, z - sz);
+
+					for (term = fmm->terms; term < terms; ++term)
+						L[term->l] += term->c * M[term->m] * d[term->d],
+						L[nc + term->l] += term->c * M[nc + term->m] * d[term->d];
+				}
+			}
+
+		if (l < fmm->levels)
+			continue;
+
+		center = V_make(fmm->min.x + (x + (real)0.5) * w, fmm->min.y + (y + (real)0.5) * w, fmm->min.z + (z + (real)0.5) * w);
+
+		for (i = FMM_begin(fmm, l, b); i < FMM_end(fmm, l, b); ++i)
+		{
+			/* the gradient of the local expansion, from units of the leaf's width */
+			hx[0] = hy[0] = (real)1;
+			hx[1] = (fmm->x[i] - center.x) / w;
+			hy[1] = (fmm->y[i] - center.y) / w;
+			D3(hz[0] = (real)1, hz[1] = (fmm->z[i] - center.z) / w;)
+
+			for (k = 2; k <= order; ++k)
+				hx[k] = hx[k - 1] * hx[1], hy[k] = hy[k - 1] * hy[1] D3(, hz[k] = hz[k - 1] * hz[1]);
+
+			qpull = mpull = V_make(0,0,0);
+
+			for (k = 1; k < nc; ++k)
+			{
+				e = FMM_exponents(fmm, k);
+				a = e[0], j = e[1];
+				D3(c = e[2];)
+
+				if (a > 0)
+					qpull.x += a * L[k] * hx[a - 1] * hy[j] D3(* hz[c]),
+					mpull.x += a * L[nc + k] * hx[a - 1] * hy[j] D3(* hz[c]);
+
+				if (j > 0)
+					qpull.y += j * L[k] * hx[a] * hy[j - 1] D3(* hz[c]),
+					mpull.y += j * L[nc + k] * hx[a] * hy[j - 1] D3(* hz[c]);
+
+#if DIM == 3
+				if (c > 0)
+					qpull.z += c * L[k] * hx[a] * hy[j] * hz[c - 1],
+					mpull.z += c * L[nc + k] * hx[a] * hy[j] * hz[c - 1];
+#endif
+			}
+
+			qpull = V_div(qpull, w * w);
+			mpull = V_div(mpull, w * w);
+
+			/* the objects of this leaf and its neighbours, as in (direct) */
+			D3(for (nz = z - 1; nz <= z + 1; ++nz))
+			for (ny = y - 1; ny <= y + 1; ++ny)
+				for (nx = x - 1; nx <= x + 1; ++nx)
+				{
+					if (nx < 0 || ny < 0 || nx >= side || ny >= side D3(|| nz < 0 || nz >= side))
+						continue;
+
+					s = FMM_box(nx, ny, nz);
+
+					for (j = FMM_begin(fmm, l, s); j < FMM_end(fmm, l, s); ++j)
+					{
+						if (j == i)
+							continue;
+
+						rx = fmm->x[j] - fmm->x[i];
+						ry = fmm->y[j] - fmm->y[i];
+						D3(rz = fmm->z[j] - fmm->z[i];)
+						rsquared = rx * rx + ry * ry D3(+ rz * rz) + e2;
+						r3 = rsquared * sqrtr(rsquared);
+
+						qpull.x += rx * fmm->charge[j] / r3, qpull.y += ry * fmm->charge[j] / r3;
+						mpull.x += rx * fmm->mass[j] / r3, mpull.y += ry * fmm->mass[j] / r3;
+						D3(qpull.z += rz * fmm->charge[j] / r3, mpull.z += rz * fmm->mass[j] / r3;)
+					}
+				}
+
+			k = fmm->index[i];
+			P->fex[k] = qpull.x * -K * P->charge[k], P->fey[k] = qpull.y * -K * P->charge[k];
+			P->fgx[k] = mpull.x * G * P->mass[k], P->fgy[k] = mpull.y * G * P->mass[k];
+			D3(P->fez[k] = qpull.z * -K * P->charge[k], P->fgz[k] = mpull.z * G * P->mass[k];)
+		}
+	}
+}
+
+int fastmultipole(struct exp *exp)
+{
+	struct fmm *fmm = &exp->fmm;
+
+	if (!mkfmm(exp))
+		return 0;
+
+	/* every level of boxes waits on the one below it when going up, and on the one above it when going down */
+	for (fmm->level = fmm->levels; fmm->level >= FMM_MINLEVELS; --fmm->level)
+		everyworker(exp, upward);
+
+	for (fmm->level = FMM_MINLEVELS; fmm->level <= fmm->levels; ++fmm->level)
+		everyworker(exp, downward);
+
+	return 1;
+}
+
+void freefmm(struct fmm *fmm)
+{
+	free(fmm->start), free(fmm->index), free(fmm->x);
+	free(fmm->multipole), free(fmm->local);
+	free(fmm->m2m), free(fmm->l2l), free(fmm->derivs), free(fmm->terms), free(fmm->exponents);
+
+	fmm->start = fmm->index = fmm->leaf = fmm->exponents = NULL;
+	fmm->x = fmm->y = fmm->charge = fmm->mass = NULL;
+	D3(fmm->z = NULL;)
+	fmm->multipole = fmm->local = fmm->m2m = fmm->l2l = fmm->derivs = NULL;
+	fmm->terms = NULL;
+	fmm->order = -1;
+}
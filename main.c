@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #include <math.h>
 #include "qsim.h"
@@ -10,27 +12,25 @@
 int             W_verbose = 0;
 pthread_mutex_t W_mutex   = PTHREAD_MUTEX_INITIALIZER;
 
-struct mutexint threads_run;
-pthread_mutex_t compiler_mutex = PTHREAD_MUTEX_INITIALIZER;
-struct mutexint C_stepsahead;
-pthread_mutex_t renderer_mutex = PTHREAD_MUTEX_INITIALIZER;
-struct mutexint R_discardable;
-
 #define main_ISCHAR  0x100
 
 int main(int argc, char **argv)
 {
-	int argi, r = EXIT_FAILURE, pthreadr;
-	const char *path = NULL;
+	int argi, r = EXIT_FAILURE, report = 0, nthreads = 1, binary = 0, fields = F_all, stride = 1, every = CK_EVERY, x;
+	int nworkers = 0, stats = 0, realsize = 0;
+	double interval = 0;
+	const char *path = NULL, *resumed = NULL, *batch = NULL;
+	char *name, *ckpath = NULL;
 	struct exp exp;
-	pthread_t compiler_thread, renderer_thread;
 
 	/* parse arguments passed to program for options */
 
 	for (argi = 1; --argc; ++argi)
 		if (argv[argi][0] == '-')
 			switch (argv[argi][1] == '-' ?
-			          arrin(&argv[argi][2], 2, "verbose", "file")
+			          arrin(&argv[argi][2], 14, "verbose", "file", "accuracy", "jobs", "binary", "output", "stride",
+				                "checkpoint", "every", "resume", "batch", "workers",
+				                "stats", "precision")
 			        : (int)argv[argi][1] | main_ISCHAR)
 			{
 			case 0:
@@ -50,126 +50,263 @@ int main(int argc, char **argv)
 
 				break;
 
-			default:
-			/* unknown option */
-				warn(WL_warn, "qsim", "Unknown option \"%a\" provided, ignoring.\n", argv[argi]);
+			case 2:
+			case (int)'a' | main_ISCHAR:
+			/* accuracy report */
+				report = 1;
 
 				break;
-			}
-		else
-			warn(WL_warn, "qsim", "Unknown argument \"%a\" provided, ignoring.\n", argv[argi]);
 
-	/* define members of certain global variables */
-	pthread_mutex_init(&threads_run.mutex, NULL);
-	threads_run.value = 1;
-	pthread_mutex_init(&C_stepsahead.mutex, NULL);
-	C_stepsahead.value = 0;
-	pthread_mutex_init(&R_discardable.mutex, NULL);
-	R_discardable.value = 0;
+			case 3:
+			case (int)'j' | main_ISCHAR:
+			/* number of threads computing frames */
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No number provided after (-j|--jobs).\n");
+				else
+				if ((nthreads = atoi(argv[++argi])) < 1)
+					warn(WL_warn, "qsim", "Number of jobs \"%a\" is not a natural number, using 1.\n", argv[argi]),
+					nthreads = 1, --argc;
+				else
+					--argc;
 
-	/* initialize the experiment structure's contents */
-	exp.title[0] = '\0';
-	exp.path[0] = '\0';
-	exp.delta = (real)0;
-	exp.limit = 0;
-	exp.system = NULL;
-	exp.nobjects = 0;
-	exp.frame = NULL;
-
-	if (path == NULL)
-		warn(WL_warn, "qsim", "No path to experiment file provided; use (-f|--file) followed by the path to an experiment file.\n");
-	else
-	if (!readexp(path, &exp))
-		warn(WL_fail, "qsim", "Could not load experiment file \"%a\" properly.\n", path);
-	else
-	if (!initexp(&exp))
-		warn(WL_fail, "qsim", "Could not initialize experiment.\n");
-	else
-	if ((pthreadr = pthread_create(&compiler_thread, NULL, compiler, (void *)&exp)))
-		warn(WL_fail, "qsim", "Could not create thread for the compiler, (pthread_create) returned %i.\n", pthreadr);
-	else
-	if ((pthreadr = pthread_create(&renderer_thread, NULL, renderer, (void *)&exp)))
-	{
-		warn(WL_fail, "qsim", "Could not create thread for the renderer, (pthread_create) returned %i.\n", pthreadr);
+				break;
 
-		setmutexint(&threads_run, 0);
-		pthread_join(compiler_thread, NULL);
-	} else {
-		warn(WL_verbose, "qsim", "Beginning %a.\n", exp.title);
+			case 4:
+			case (int)'b' | main_ISCHAR:
+			/* binary output */
+				binary = 1;
 
-		struct frame *next;
+				break;
 
-		warn(WL_verbose, "discarder", "Initialized.\n");
+			case 5:
+			case (int)'o' | main_ISCHAR:
+			/* fields rendered, separated by commas */
+				if (argc == 1)
+				{
+					warn(WL_fail, "qsim", "No fields provided after (-o|--output).\n");
 
-		for (;;)
-		{
-			pthread_mutex_lock(&R_discardable.mutex);
+					break;
+				}
 
-			if (R_discardable.value == 0)
-			/* wait until there are frames to discard */
-			{
-				pthread_mutex_unlock(&R_discardable.mutex);
+				--argc;
+				fields = 0;
 
-				for (;;)
+				if (strcmp(argv[argi + 1], "none") == 0)
+				/* render nothing */
 				{
-					catchmutex(&renderer_mutex);
-					pthread_mutex_lock(&R_discardable.mutex);
+					++argi;
 
-					if (R_discardable.value > 0)
-						break;
+					break;
+				}
 
-					if (!readmutexint(&threads_run))
-						break;
+				for (name = strtok(argv[++argi], ","); name != NULL; name = strtok(NULL, ","))
+					if ((x = arrin(name, F_COUNT, F_NAMES)) != -1)
+						fields |= 1 << x;
+					else
+						warn(WL_warn, "qsim", "Field \"%a\" is not known, ignoring.\n", name);
 
-					pthread_mutex_unlock(&R_discardable.mutex);
-				}
-			}
+				if (fields == 0)
+					warn(WL_warn, "qsim", "No known fields provided after (-o|--output), rendering all of them.\n"),
+					fields = F_all;
 
-			if (!readmutexint(&threads_run) && R_discardable.value == 0)
-			{
-				pthread_mutex_unlock(&R_discardable.mutex);
+				break;
+
+			case 6:
+			case (int)'s' | main_ISCHAR:
+			/* number of frames between those rendered */
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No number provided after (-s|--stride).\n");
+				else
+				if ((stride = atoi(argv[++argi])) < 1)
+					warn(WL_warn, "qsim", "Stride \"%a\" is not a natural number, using 1.\n", argv[argi]),
+					stride = 1, --argc;
+				else
+					--argc;
 
 				break;
-			}
 
-			warn(WL_verbose, "discarder", "Discarding %i frame(s).\n", R_discardable.value);
+			case 7:
+			case (int)'c' | main_ISCHAR:
+			/* file that checkpoints are written to */
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No file provided after (-c|--checkpoint).\n");
+				else
+				if (strlen(argv[++argi]) >= exp_PATHSIZE)
+					warn(WL_warn, "qsim", "Checkpoint file \"%a\" has too long a path, ignoring.\n", argv[argi]), --argc;
+				else
+					ckpath = argv[argi], --argc;
 
-			do {
-				next = exp.frame->next;
+				break;
 
-				free(exp.frame->system);
-				free(exp.frame);
+			case 8:
+			case (int)'e' | main_ISCHAR:
+			/* number of frames between checkpoints */
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No number provided after (-e|--every).\n");
+				else
+				if ((every = atoi(argv[++argi])) < 1)
+					warn(WL_warn, "qsim", "Frames between checkpoints \"%a\" is not a natural number, using %i.\n", argv[argi], CK_EVERY),
+					every = CK_EVERY, --argc;
+				else
+					--argc;
 
-				exp.frame = next;
-			}
-			while (--R_discardable.value);
+				break;
 
-			if (!readmutexint(&threads_run))
-			{
-				pthread_mutex_unlock(&R_discardable.mutex);
+			case 9:
+			case (int)'r' | main_ISCHAR:
+			/* checkpoint to resume from */
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No checkpoint provided after (-r|--resume).\n");
+				else
+				if (strlen(argv[++argi]) >= exp_PATHSIZE)
+					warn(WL_warn, "qsim", "Checkpoint \"%a\" has too long a path, ignoring.\n", argv[argi]), --argc;
+				else
+					resumed = argv[argi], --argc;
+
+				break;
+
+			case 10:
+			case (int)'B' | main_ISCHAR:
+			/* directory of experiment files, or list of them, to run as a batch */
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No directory or list of experiment files provided after (-B|--batch).\n");
+				else
+					batch = argv[++argi], --argc;
+
+				break;
+
+			case 11:
+			case (int)'w' | main_ISCHAR:
+			/* number of experiments of a batch, or runs of a sweep, run at once */
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No number provided after (-w|--workers).\n");
+				else
+				if ((nworkers = atoi(argv[++argi])) < 1)
+					warn(WL_warn, "qsim", "Number of workers \"%a\" is not a natural number, using one for every CPU.\n", argv[argi]),
+					nworkers = 0, --argc;
+				else
+					--argc;
+
+				break;
+
+			case 12:
+			case (int)'S' | main_ISCHAR:
+			/* report the stats of every run, and write a line of them every so many seconds, unless 0 */
+				stats = 1;
+
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No number of seconds provided after (-S|--stats).\n");
+				else
+				if ((interval = atof(argv[++argi])) < 0)
+					warn(WL_warn, "qsim", "Seconds between stats \"%a\" is less than zero, writing none.\n", argv[argi]),
+					interval = 0, --argc;
+				else
+					--argc;
+
+				break;
+
+			case 13:
+			case (int)'p' | main_ISCHAR:
+			/* precision of the reals of binary output, if narrower than those of the build */
+				if (argc == 1)
+					warn(WL_fail, "qsim", "No precision provided after (-p|--precision).\n");
+				else
+				if (strcmp(argv[++argi], "float") == 0)
+					realsize = sizeof(float), --argc;
+				else
+				if (strcmp(argv[argi], "double") == 0)
+					realsize = sizeof(double), --argc;
+				else
+					warn(WL_warn, "qsim", "Precision \"%a\" is not float or double, ignoring.\n", argv[argi]), --argc;
+
+				break;
+
+			default:
+			/* unknown option */
+				warn(WL_warn, "qsim", "Unknown option \"%a\" provided, ignoring.\n", argv[argi]);
 
 				break;
 			}
+		else
+			warn(WL_warn, "qsim", "Unknown argument \"%a\" provided, ignoring.\n", argv[argi]);
+
+	/* initialize the experiment structure's contents */
+	mkexp(&exp);
+	exp.binary = binary;
+	exp.fields = fields;
+	exp.stride = stride;
+	exp.pool.nthreads = nthreads;
+	exp.stats.every = interval;
+	exp.stats.report = stats;
+
+	if (realsize == 0)
+		;
+	else
+	if (!binary)
+		warn(WL_warn, "qsim", "Precision given without (-b|--binary), ignoring.\n");
+	else
+	if (realsize > exp.realsize)
+		warn(WL_warn, "qsim", "Precision given is wider than that of this build, ignoring.\n");
+	else
+		exp.realsize = realsize;
+
+	if (ckpath != NULL)
+		strcpy(exp.checkpoint.path, ckpath), exp.checkpoint.every = every;
+
+	if (batch != NULL && (path != NULL || resumed != NULL || report || ckpath != NULL))
+		warn(WL_warn, "qsim", "Running a batch, ignoring (-f|--file), (-r|--resume), (-a|--accuracy) and (-c|--checkpoint).\n");
+	else
+	if (resumed != NULL && path != NULL)
+		warn(WL_warn, "qsim", "Resuming from a checkpoint, ignoring the experiment file.\n");
+
+	/* experiments of a batch, or runs of a sweep, run at once; by default, one for every CPU */
+	if (nworkers == 0 && (nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		nworkers = 1;
 
-			pthread_mutex_unlock(&R_discardable.mutex);
-		}
+	if (batch != NULL)
+	/* run every experiment of the batch, each with the options above */
+	{
+		if (runbatch(batch, nworkers, &exp) == 0)
+			r = EXIT_SUCCESS;
+	} else
+	if (resumed == NULL && path == NULL)
+		warn(WL_warn, "qsim", "No path to experiment file provided; use (-f|--file) followed by the path to an experiment file.\n");
+	else
+	if (resumed != NULL && !readcheckpoint(resumed, &exp))
+		warn(WL_fail, "qsim", "Could not load checkpoint \"%a\" properly.\n", resumed);
+	else
+	if (resumed == NULL && !readexp(path, &exp))
+		warn(WL_fail, "qsim", "Could not load experiment file \"%a\" properly.\n", path);
+	else
+	if (!initexp(&exp))
+		warn(WL_fail, "qsim", "Could not initialize experiment.\n");
+	else
+	if (report)
+	/* report on the accuracy of the routine instead of running the experiment */
+		accuracy(&exp), r = EXIT_SUCCESS;
+	else
+	if (exp.sweep != NULL)
+	/* run every run of the sweep, each to a file of its own */
+	{
+		if (ckpath != NULL)
+			warn(WL_warn, "qsim", "Running a sweep, ignoring (-c|--checkpoint).\n");
 
-		warn(WL_verbose, "discarder", "Terminated.\n");
+		if (runsweep(&exp, nworkers) == 0)
+			r = EXIT_SUCCESS;
+	} else
+	{
+		if (resumed != NULL)
+			resume(&exp);
 
-		pthread_join(compiler_thread, NULL);
-		pthread_join(renderer_thread, NULL);
+		warn(WL_verbose, "qsim", "Beginning %a.\n", exp.title);
 
-		r = EXIT_SUCCESS;
+		if (runexp(&exp))
+			r = EXIT_SUCCESS;
 	}
 
 	freeexp(&exp);
 
 	pthread_mutex_destroy(&W_mutex);
-	pthread_mutex_destroy(&threads_run.mutex);
-	pthread_mutex_destroy(&compiler_mutex);
-	pthread_mutex_destroy(&C_stepsahead.mutex);
-	pthread_mutex_destroy(&renderer_mutex);
-	pthread_mutex_destroy(&R_discardable.mutex);
 
 	warn(WL_verbose, "qsim", "Returned %i.\n", r);
 
@@ -0,0 +1,466 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "qsim.h"
+
+#define PM_OBJECTS  4     /* objects per cell, on average, that the mesh is chosen for if it is not given */
+#define PM_CELLS    8     /* cells within the cutoff, at least, that the mesh is chosen for if it is not given */
+#if DIM == 3
+#define PM_MOST     64    /* cells along each side that are chosen at most */
+#else
+#define PM_MOST     1024
+#endif
+
+/* PM_image: Return the component (_u) of a radius vector, to the nearest image in a box as wide as (_w), if any. */
+#define PM_image(_u, _w)  ((_w) != 0 ? (_u) - (_w) * floorr((_u) / (_w) + (real)0.5) : (_u))
+
+/* PM_points: Return the number of points of the mesh of the pm structure (_M). */
+#define PM_points(_M)  ((long)(_M)->n * (_M)->n D3(* (_M)->n))
+
+/* PM_point: Return the index of the point (_x, _y, _z) of the pm structure (_M), wrapped around the mesh; (_z) is not
+ * evaluated in two dimensions. */
+#define PM_point(_M, _x, _y, _z)  ((((_y) & ((_M)->n - 1)) D3(+ ((_z) & ((_M)->n - 1)) * (_M)->n)) * (_M)->n \
+                                   + ((_x) & ((_M)->n - 1)))
+
+/* fft: Transform the (n) complex numbers of (z), each as its real part followed by its imaginary part, in place,
+ * into the sums of z[j] exp(sign 2 pi i j k / n) for every k, by the radix-2 algorithm of Cooley and Tukey; (n) is
+ * a power of two, and (w) holds the cosines and sines of 2 pi k / n, for k up to n / 2.
+ */
+static void fft(real *z, int n, int sign, const real *w)
+{
+	real tr, ti, wr, wi, *a, *b;
+	int i, j, k, half, step;
+
+	/* into the order of the bits of every index reversed */
+	for (i = 1, j = 0; i < n; ++i)
+	{
+		for (k = n >> 1; j & k; k >>= 1)
+			j ^= k;
+
+		j |= k;
+
+		if (i < j)
+			tr = z[2 * i], z[2 * i] = z[2 * j], z[2 * j] = tr,
+			ti = z[2 * i + 1], z[2 * i + 1] = z[2 * j + 1], z[2 * j + 1] = ti;
+	}
+
+	for (half = 1, step = n >> 1; half < n; half <<= 1, step >>= 1)
+		for (i = 0; i < n; i += 2 * half)
+			for (k = 0; k < half; ++k)
+			{
+				wr = w[2 * k * step], wi = sign * w[2 * k * step + 1];
+				a = &z[2 * (i + k)], b = &z[2 * (i + k + half)];
+
+				tr = b[0] * wr - b[1] * wi, ti = b[0] * wi + b[1] * wr;
+				b[0] = a[0] - tr, b[1] = a[1] - ti;
+				a[0] += tr, a[1] += ti;
+			}
+}
+
+/* transform: Transform the lines of the mesh being transformed along its axis that are given to (worker); the rows
+ * are transformed in place, and any other line is copied out into the worker's own column, so that it is
+ * transformed from memory near each other.
+ */
+static void transform(struct exp *exp, int worker, int nworkers)
+{
+	struct pm *M = &exp->pm;
+	real *column = M->column + worker * 2 * M->n;
+	long lines = PM_points(M) / M->n, from = lines * worker / nworkers, to = lines * (worker + 1) / nworkers;
+	long stride, first, i;
+	int n = M->n, j;
+
+	/* the points of a line along the axis are (stride) apart */
+	for (stride = 1, j = 0; j < M->axis; ++j)
+		stride *= n;
+
+	for (i = from; i < to; ++i)
+	{
+		if (M->axis == 0)
+		{
+			fft(M->pass + i * 2 * n, n, M->sign, M->twiddles);
+
+			continue;
+		}
+
+		first = i / stride * stride * n + i % stride;
+
+		for (j = 0; j < n; ++j)
+			column[2 * j] = M->pass[(first + j * stride) * 2], column[2 * j + 1] = M->pass[(first + j * stride) * 2 + 1];
+
+		fft(column, n, M->sign, M->twiddles);
+
+		for (j = 0; j < n; ++j)
+			M->pass[(first + j * stride) * 2] = column[2 * j], M->pass[(first + j * stride) * 2 + 1] = column[2 * j + 1];
+	}
+}
+
+/* fourier: Transform the mesh (mesh) of (exp) in every dimension, with the sign (sign), split between the workers;
+ * every line along one axis is transformed before any along the next.
+ */
+static void fourier(struct exp *exp, real *mesh, int sign)
+{
+	exp->pm.pass = mesh;
+	exp->pm.sign = sign;
+
+	for (exp->pm.axis = 0; exp->pm.axis < DIM; ++exp->pm.axis)
+		everyworker(exp, transform);
+}
+
+/* window: Return the transform of the triangular-shaped cloud along one axis, at the wave (k) of a mesh of (n). */
+static real window(int k, int n)
+{
+	real t = (real)M_PI * k / n;
+
+	return k == 0 ? 1 : powr(sinr(t) / t, 3);
+}
+
+/* green: Fill the green functions of the mesh of (exp). In a periodic box, the force of a unit charge is the sum
+ * over its waves, each of -i k 2 pi / (A |k|), times erfc(|k| / 2 alpha) for the part left to the mesh if the forces
+ * near each object are summed apart; or in space, of -i k 4 pi / (V |k|^2), times exp(-|k|^2 / 4 alpha^2). In open
+ * space, it is the force r / r^3 at every point of the mesh, or of the part erf(alpha r) / r of the potential,
+ * transformed as the real and imaginary parts of one mesh (and the z-components as the real parts of another).
+ */
+static void green(struct exp *exp)
+{
+	struct pm *M = &exp->pm;
+	real *g = M->green, kx, ky, D3(kz,) k, f, rx, ry, D3(rz,) r, alpha = M->alpha;
+	vector v;
+	long p, points = PM_points(M);
+	int n = M->n, a, b D3(, c);
+
+	for (p = 0; p < points; ++p)
+	{
+		a = (int)(p % n), b = (int)(p / n % n);
+		D3(c = (int)(p / n / n);)
+
+		/* the offsets of a and b (and c) from the first point, either way around the mesh; those of n / 2 either
+		 * way are left out, so that each force is as odd as the mesh can make it */
+		if (a == n / 2 || b == n / 2 D3(|| c == n / 2))
+			v = V_make(0,0,0);
+		else
+		if (exp->box.x != 0)
+		{
+			kx = 2 * (real)M_PI * (a < n / 2 ? a : a - n) / exp->box.x;
+			ky = 2 * (real)M_PI * (b < n / 2 ? b : b - n) / exp->box.y;
+			D3(kz = 2 * (real)M_PI * (c < n / 2 ? c : c - n) / exp->box.z;)
+
+			if ((k = sqrtr(kx * kx + ky * ky D3(+ kz * kz))) == 0)
+				v = V_make(0,0,0);
+			else
+			{
+#if DIM == 3
+				f = 4 * (real)M_PI / (exp->box.x * exp->box.y * exp->box.z * k * k)
+				  * (alpha != 0 ? expr(-k * k / (4 * alpha * alpha)) : 1);
+#else
+				f = 2 * (real)M_PI / (exp->box.x * exp->box.y * k) * (alpha != 0 ? erfcr(k / (2 * alpha)) : 1);
+#endif
+				v = V_make(-kx * f, -ky * f, -kz * f);
+			}
+		} else
+		{
+			rx = (a < n / 2 ? a : a - n) * M->h.x;
+			ry = (b < n / 2 ? b : b - n) * M->h.y;
+			D3(rz = (c < n / 2 ? c : c - n) * M->h.z;)
+
+			if ((r = sqrtr(rx * rx + ry * ry D3(+ rz * rz))) == 0)
+				v = V_make(0,0,0);
+			else
+			{
+				/* (f) is that of the force, as r / r^3 is of 1 / r^2 */
+				if (alpha != 0)
+					f = ((1 - erfcr(alpha * r)) / r - (real)M_2_SQRTPI * alpha * expr(-alpha * alpha * r * r)) / (r * r);
+				else
+					f = 1 / (r * r * r);
+
+				v = V_make(rx * f, ry * f, rz * f);
+			}
+		}
+
+		if (exp->box.x != 0)
+			g[DIM * p] = v.x, g[DIM * p + 1] = v.y D3(, g[DIM * p + 2] = v.z);
+		else
+			M->fx[2 * p] = v.x, M->fx[2 * p + 1] = v.y D3(, M->fz[2 * p] = v.z, M->fz[2 * p + 1] = 0);
+	}
+
+	if (exp->box.x == 0)
+	/* the transform of the real x-components, and of the real y-components as imaginary parts, are both imaginary,
+	 * as the components are odd; so that they are apart in the imaginary and real parts of the transform. The
+	 * transform back is not divided by the number of points, so they are, here. */
+	{
+		fourier(exp, M->fx, -1);
+		D3(fourier(exp, M->fz, -1);)
+
+		for (p = 0; p < points; ++p)
+			g[DIM * p] = M->fx[2 * p + 1] / (real)points, g[DIM * p + 1] = -M->fx[2 * p] / (real)points
+			D3(, g[DIM * p + 2] = M->fz[2 * p + 1] / (real)points);
+	}
+
+	/* each object is spread, and its force interpolated, by the cloud, whose transform is sinc^3 along each axis;
+	 * so that the mesh is divided by its square, where the forces left to it are smooth enough that the shortest
+	 * waves are not raised too far by it */
+	for (p = 0; p < points && alpha != 0; ++p)
+	{
+		a = (int)(p % n), b = (int)(p / n % n);
+		D3(c = (int)(p / n / n);)
+		f = window(a < n / 2 ? a : a - n, n) * window(b < n / 2 ? b : b - n, n) D3(* window(c < n / 2 ? c : c - n, n));
+		g[DIM * p] /= f * f, g[DIM * p + 1] /= f * f;
+		D3(g[DIM * p + 2] /= f * f;)
+	}
+}
+
+/* mkpm: Make the mesh of (exp) for its objects, unless one that fits them was made already, and its green functions
+ * for the mesh's spacing; a mesh that is not given is chosen for the number of objects, and the cutoff. In
+ * open space, the spacing is a power of 2^(1/4), so that it is only chosen again once the objects have spread or
+ * gathered by that much. Returns 0 on failure, and 1 on success.
+ */
+static int mkpm(struct exp *exp)
+{
+	struct pm *M = &exp->pm;
+	struct particles *P = &exp->particles;
+	vector min, max;
+	real width, h;
+	long points;
+	int i, nworkers = exp->pool.threads == NULL ? 1 : exp->pool.nthreads, n = exp->nobjects;
+
+	/* bounds of the objects, in open space */
+	min = max = V_make(P->x[0], P->y[0], P->z[0]);
+
+	for (i = 1; i < n && exp->box.x == 0; ++i)
+	{
+		min.x = P->x[i] < min.x ? P->x[i] : min.x;
+		min.y = P->y[i] < min.y ? P->y[i] : min.y;
+		max.x = P->x[i] > max.x ? P->x[i] : max.x;
+		max.y = P->y[i] > max.y ? P->y[i] : max.y;
+		D3(min.z = P->z[i] < min.z ? P->z[i] : min.z;)
+		D3(max.z = P->z[i] > max.z ? P->z[i] : max.z;)
+	}
+
+	width = max.x - min.x > max.y - min.y ? max.x - min.x : max.y - min.y;
+	D3(width = max.z - min.z > width ? max.z - min.z : width;)
+
+	if (width == (real)0)
+		width = (real)1;
+
+	if (exp->mesh == 0)
+	/* about PM_OBJECTS objects in each cell, if they were spread evenly, and PM_CELLS cells within the cutoff; chosen
+	 * once, for the objects as they are first, and kept as if it were given, so that it is the same in a run
+	 * resumed from a checkpoint */
+	{
+		for (exp->mesh = PM_MINMESH; exp->mesh < PM_MOST && (long)exp->mesh * exp->mesh D3(* exp->mesh) * PM_OBJECTS < n; )
+			exp->mesh *= 2;
+
+		h = exp->box.x == 0 ? width : exp->box.x > exp->box.y ? exp->box.x : exp->box.y;
+		D3(h = exp->box.x != 0 && exp->box.z > h ? exp->box.z : h;)
+
+		while (exp->cutoff != 0 && exp->mesh < PM_MOST && h / (exp->mesh - (exp->box.x != 0 ? 0 : 3)) > exp->cutoff / PM_CELLS)
+			exp->mesh *= 2;
+	}
+
+	if (M->fx == NULL || M->madefor[0] != exp->mesh || M->madefor[1] != exp->cutoff || M->nworkers < nworkers)
+	{
+		M->cells = exp->mesh;
+		M->n = exp->box.x != 0 ? M->cells : 2 * M->cells;
+		M->alpha = exp->cutoff != 0 ? (real)EW_SPLIT / exp->cutoff : 0;
+		M->nworkers = nworkers;
+		points = PM_points(M);
+
+		free(M->fx), free(M->twiddles);
+
+		/* (fx) owns the memory of (rho), (fz) and (green), and (twiddles) that of (column) */
+		if ((M->fx = malloc(3 * DIM * (size_t)points * sizeof(real))) == NULL
+		 || (M->twiddles = malloc((M->n + 2 * nworkers * M->n) * sizeof(real))) == NULL)
+		{
+			warn(WL_crash, "pm", "malloc returned NULL when attempting allocation of the mesh.\n");
+			freepm(M);
+
+			return 0;
+		}
+
+		M->rho = M->fx + 2 * points;
+		D3(M->fz = M->rho + 2 * points;)
+		M->green = M->fx + 2 * DIM * points;
+		M->column = M->twiddles + M->n;
+
+		for (i = 0; i < M->n / 2; ++i)
+			M->twiddles[2 * i] = cosr(2 * (real)M_PI * i / M->n), M->twiddles[2 * i + 1] = sinr(2 * (real)M_PI * i / M->n);
+
+		M->madefor[0] = exp->mesh, M->madefor[1] = exp->cutoff;
+		M->madefor[2] = -1;
+	}
+
+	if (exp->box.x != 0)
+	{
+		M->min = V_make(0,0,0);
+		M->h = V_make(exp->box.x / M->cells, exp->box.y / M->cells, exp->box.z / M->cells);
+	} else
+	/* the objects are within the cells from 1 up to (cells - 2), so that each is spread over three cells of the
+	 * mesh either way */
+	{
+		h = (real)pow(2.0, ceil(4 * log2((double)width / (M->cells - 3))) / 4);
+		M->h = V_make(h, h, h);
+		M->min = V_make(min.x - h, min.y - h, min.z - h);
+	}
+
+	if (M->madefor[2] != M->h.x || M->madefor[3] != exp->box.x || M->madefor[4] != exp->box.y
+	 D3(|| M->madefor[5] != exp->box.z))
+	{
+		green(exp);
+		M->madefor[2] = M->h.x, M->madefor[3] = exp->box.x, M->madefor[4] = exp->box.y;
+		D3(M->madefor[5] = exp->box.z;)
+	}
+
+	return 1;
+}
+
+/* weights: Set (p) to the point nearest to (u), in units of the spacing of the mesh, and (w) to the weights of the
+ * points (p - 1), (p) and (p + 1) of the triangular-shaped cloud about (u).
+ */
+static void weights(real u, int *p, real *w)
+{
+	real d;
+
+	*p = (int)floorr(u + (real)0.5);
+	d = u - *p;
+
+	w[0] = ((real)0.5 - d) * ((real)0.5 - d) / 2;
+	w[1] = (real)0.75 - d * d;
+	w[2] = ((real)0.5 + d) * ((real)0.5 + d) / 2;
+}
+
+/* assign: Spread the charge and mass of every object over the points of the mesh about it, in order. */
+static void assign(struct exp *exp)
+{
+	struct particles *P = &exp->particles;
+	struct pm *M = &exp->pm;
+	real wx[3], wy[3], D3(wz[3],) w;
+	int i, a, b, D3(c, pz,) px, py, p;
+
+	memset(M->rho, 0, 2 * (size_t)PM_points(M) * sizeof(real));
+
+	for (i = 0; i < exp->nobjects; ++i)
+	{
+		weights((P->x[i] - M->min.x) / M->h.x, &px, wx);
+		weights((P->y[i] - M->min.y) / M->h.y, &py, wy);
+		D3(weights((P->z[i] - M->min.z) / M->h.z, &pz, wz);)
+
+		D3(for (c = 0; c < 3; ++c))
+		for (b = 0; b < 3; ++b)
+			for (a = 0; a < 3; ++a)
+			{
+				p = PM_point(M, px + a - 1, py + b - 1, pz + c - 1);
+				w = wx[a] * wy[b] D3(* wz[c]);
+				M->rho[2 * p] += w * P->charge[i], M->rho[2 * p + 1] += w * P->mass[i];
+			}
+	}
+}
+
+/* convolve: Multiply the transform of the charges and masses by the green functions, at the points of the mesh given
+ * to (worker), into the transforms of the x-, y- (and z-) components of the forces; i times each, as they are
+ * imaginary.
+ */
+static void convolve(struct exp *exp, int worker, int nworkers)
+{
+	struct pm *M = &exp->pm;
+	real re, im;
+	long p, to = PM_points(M) * (worker + 1) / nworkers;
+
+	for (p = PM_points(M) * worker / nworkers; p < to; ++p)
+	{
+		re = M->rho[2 * p], im = M->rho[2 * p + 1];
+
+		M->fx[2 * p] = -M->green[DIM * p] * im, M->fx[2 * p + 1] = M->green[DIM * p] * re;
+		D3(M->fz[2 * p] = -M->green[DIM * p + 2] * im, M->fz[2 * p + 1] = M->green[DIM * p + 2] * re;)
+		M->rho[2 * p] = -M->green[DIM * p + 1] * im, M->rho[2 * p + 1] = M->green[DIM * p + 1] * re;
+	}
+}
+
+/* interpolate: Calculate the forces on the objects from (from) up to (to), in the order of the grid of the lists if
+ * the forces near each object are summed apart; from the forces at the points of the mesh about each, with the same
+ * weights that it was spread over them with, and those of its neighbours within the cutoff, which fall off as
+ * erfc(alpha r).
+ */
+static void interpolate(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	struct lists *L = &exp->lists;
+	struct pm *M = &exp->pm;
+	real wx[3], wy[3], D3(wz[3],) w, rx, ry, D3(rz,) rsquared, r;
+	real e2 = exp->softening * exp->softening, c2 = exp->cutoff * exp->cutoff, alpha = M->alpha;
+	vector qpull, mpull;
+	long k;
+	int a, b, D3(c, pz,) i, j, n, px, py, p;
+
+	for (n = from; n < to; ++n)
+	{
+		i = alpha != 0 ? L->sorted[n] : n;
+		qpull = mpull = V_make(0,0,0);
+
+		weights((P->x[i] - M->min.x) / M->h.x, &px, wx);
+		weights((P->y[i] - M->min.y) / M->h.y, &py, wy);
+		D3(weights((P->z[i] - M->min.z) / M->h.z, &pz, wz);)
+
+		D3(for (c = 0; c < 3; ++c))
+		for (b = 0; b < 3; ++b)
+			for (a = 0; a < 3; ++a)
+			{
+				p = PM_point(M, px + a - 1, py + b - 1, pz + c - 1);
+				w = wx[a] * wy[b] D3(* wz[c]);
+				qpull.x += w * M->fx[2 * p], qpull.y += w * M->rho[2 * p];
+				mpull.x += w * M->fx[2 * p + 1], mpull.y += w * M->rho[2 * p + 1];
+				D3(qpull.z += w * M->fz[2 * p], mpull.z += w * M->fz[2 * p + 1];)
+			}
+
+		for (k = alpha != 0 ? L->start[i] : 0; alpha != 0 && k < L->start[i + 1]; ++k)
+		{
+			j = L->index[k];
+			rx = PM_image(P->x[i] - L->x[j], exp->box.x), ry = PM_image(P->y[i] - L->y[j], exp->box.y);
+			D3(rz = PM_image(P->z[i] - L->z[j], exp->box.z);)
+
+			if ((rsquared = rx * rx + ry * ry D3(+ rz * rz)) >= c2)
+				continue;
+
+			/* (w) is that of the force of erfc(alpha r) / r, softened, as in (ewald) */
+			rsquared += e2;
+			r = sqrtr(rsquared);
+			w = (erfcr(alpha * r) / r + (real)M_2_SQRTPI * alpha * expr(-alpha * alpha * rsquared)) / rsquared;
+
+			qpull.x += rx * L->charge[j] * w, qpull.y += ry * L->charge[j] * w;
+			mpull.x += rx * L->mass[j] * w, mpull.y += ry * L->mass[j] * w;
+			D3(qpull.z += rz * L->charge[j] * w, mpull.z += rz * L->mass[j] * w;)
+		}
+
+		/* like charges repel, and masses attract */
+		P->fex[i] = qpull.x * K * P->charge[i], P->fey[i] = qpull.y * K * P->charge[i];
+		P->fgx[i] = mpull.x * -G * P->mass[i], P->fgy[i] = mpull.y * -G * P->mass[i];
+		D3(P->fez[i] = qpull.z * K * P->charge[i], P->fgz[i] = mpull.z * -G * P->mass[i];)
+	}
+}
+
+int pm(struct exp *exp)
+{
+	if (!mkpm(exp) || (exp->pm.alpha != 0 && !mklists(exp)))
+		return 0;
+
+	assign(exp);
+	fourier(exp, exp->pm.rho, -1);
+	everyworker(exp, convolve);
+	fourier(exp, exp->pm.fx, 1);
+	fourier(exp, exp->pm.rho, 1);
+	D3(fourier(exp, exp->pm.fz, 1);)
+	parallel(exp, interpolate);
+
+	return 1;
+}
+
+void freepm(struct pm *pm)
+{
+	free(pm->fx), free(pm->twiddles);
+
+	pm->fx = pm->rho = pm->green = pm->twiddles = pm->column = NULL;
+	D3(pm->fz = NULL;)
+	pm->nworkers = 0;
+	pm->madefor[0] = -1;
+}
@@ -6,9 +6,19 @@
 #include <math.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <float.h>
+#include <limits.h>
 
 #include "qsim.h"
 
+#if defined(PRECISION_double)
+double expd(double x)
+{
+	return exp(x);
+}
+#endif
+
 int arrin(const char *arr, int narr, ...)
 {
 	va_list ap;
@@ -133,6 +143,7 @@ vector V_add(vector a, vector b)
 
 	c.x = a.x + b.x;
 	c.y = a.y + b.y;
+	D3(c.z = a.z + b.z;)
 
 	return c;
 }
@@ -143,6 +154,7 @@ vector V_mul(vector a, real mul)
 
 	b.x = a.x * mul;
 	b.y = a.y * mul;
+	D3(b.z = a.z * mul;)
 
 	return b;
 }
@@ -153,6 +165,7 @@ vector V_sub(vector a, vector b)
 
 	c.x = a.x - b.x;
 	c.y = a.y - b.y;
+	D3(c.z = a.z - b.z;)
 
 	return c;
 }
@@ -163,6 +176,7 @@ vector V_div(vector a, real quo)
 
 	b.x = a.x / quo;
 	b.y = a.y / quo;
+	D3(b.z = a.z / quo;)
 
 	return b;
 }
@@ -209,196 +223,353 @@ int decmutexint(struct mutexint *MI)
 	return value;
 }
 
-#define RD_ARRSIZE  32
+void stopthreads(struct exp *exp)
+{
+	setmutexint(&exp->run, 0);
+
+	/* wake the compiler or renderer if it is waiting for the other */
+	pthread_mutex_lock(&exp->stepsahead.mutex);
+	pthread_cond_broadcast(&exp->signal);
+	pthread_mutex_unlock(&exp->stepsahead.mutex);
+}
+
+void initbarrier(struct barrier *B, int nthreads)
+{
+	pthread_mutex_init(&B->mutex, NULL);
+	pthread_cond_init(&B->cond, NULL);
+	B->count = 0;
+	B->nthreads = nthreads;
+	B->generation = 0;
+}
+
+void waitbarrier(struct barrier *B)
+{
+	int generation;
+
+	pthread_mutex_lock(&B->mutex);
+	generation = B->generation;
+
+	if (++B->count == B->nthreads)
+	/* last to arrive; release the others */
+	{
+		B->count = 0;
+		++B->generation;
+		pthread_cond_broadcast(&B->cond);
+	} else
+		while (generation == B->generation)
+			pthread_cond_wait(&B->cond, &B->mutex);
+
+	pthread_mutex_unlock(&B->mutex);
+}
+
+void freebarrier(struct barrier *B)
+{
+	pthread_mutex_destroy(&B->mutex);
+	pthread_cond_destroy(&B->cond);
+}
+
+/* longest datum read, with its unit; and the most digits of an exponent that are read */
+#define RD_ARRSIZE  128
+#define RD_EXPMAX   100000
+
+/* most digits of a number, and greatest power of ten, that are held exactly by the real type */
+#if defined(PRECISION_float)
+#define RD_DIGITS  7
+#define RD_EXACT   10
+#elif defined(PRECISION_double) || LDBL_MANT_DIG < 64
+#define RD_DIGITS  15
+#define RD_EXACT   22
+#else
+#define RD_DIGITS  19
+#define RD_EXACT   27
+#endif
+
+/* powers of ten, up to RD_EXACT */
+static const real tens[] = {
+	1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L,
+	1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+};
+
+/* constants, by their names in lower case; masses must be in (g) */
+static const struct
+{
+	const char *name;
+	real value;
+} constants[] = {
+	{ "e",  (real)EC },
+	{ "pm", (real)PM * (real)1e3 },
+	{ "nm", (real)NM * (real)1e3 },
+	{ "em", (real)EM * (real)1e3 },
+	{ "na", (real)0 }
+};
+
+/* metric multipliers, as powers of ten */
+static const struct
+{
+	char prefix;
+	int power;
+} multipliers[] = {
+	{ 'P', 15 }, { 'T', 12 }, { 'G', 9 }, { 'M', 6 }, { 'k', 3 }, { 'h', 2 }, { 'd', -1 }, { 'c', -2 }, { 'm', -3 },
+	{ 'u', -6 }, { 'n', -9 }, { 'p', -12 }, { 'f', -15 }
+};
+
+/* readtoken: Read the characters from file (f), beginning with (c), into (arr) with size RD_ARRSIZE, until a space, a
+ * character in (term), or EOF; and return the character that ended it. Sets (*r) to the index of that character in
+ * (term), or -1; and sets (*toolong) if the characters did not fit.
+ */
+static int readtoken(FILE *f, int c, const char *term, char *arr, int *r, int *toolong)
+{
+	int i = 0;
+
+	for (*r = -1; c != EOF && !isspace(c) && (*r = cin(c, term)) == -1; c = getc_unlocked(f))
+		if (i < RD_ARRSIZE - 1)
+			arr[i++] = c;
+		else
+			*toolong = 1;
+
+	arr[i] = '\0';
+
+	return c;
+}
+
+/* readlist: Read a list, `{a, b, c}', or a range, `{first : last : n}', from file (f) into the list of (datum), after
+ * its `{'; then read until a character in (term), as (readdatum) does. A list that is not proper is warned of, and
+ * only its first value is kept, as a single datum.
+ */
+static int readlist(FILE *f, const char *term, struct datum *datum)
+{
+	struct datum d = *datum;
+	int c, r = -1, x, commas = 0, colons = 0;
+	real *list;
+	int *lunits;
+
+	/* each datum is read with a list of its own, so that a list within a list is not read into this one */
+	d.list = NULL, d.lunits = NULL, d.size = 0;
+
+	do
+	{
+		if ((x = readdatum(f, ",:}", &d)) == -1)
+			break;
+
+		if (d.nlist != 0)
+			warn(WL_info, "readdatum", "A list may not be within a list, using its first value.\n");
+
+		if (datum->nlist == datum->size)
+		{
+			if ((list = realloc(datum->list, (datum->size + 8) * sizeof(real))) != NULL)
+				datum->list = list;
+
+			if ((lunits = realloc(datum->lunits, (datum->size + 8) * sizeof(int))) != NULL)
+				datum->lunits = lunits;
+
+			if (list == NULL || lunits == NULL)
+				warn(WL_crash, "readdatum", "realloc returned NULL.\n"),
+				exit(EXIT_FAILURE);
+
+			datum->size += 8;
+		}
+
+		datum->list[datum->nlist] = d.value;
+		datum->lunits[datum->nlist++] = d.unit;
+
+		commas += x == 0, colons += x == 1;
+	} while (x != 2);
+
+	free(d.list), free(d.lunits);
+
+	if (x == -1)
+	{
+		datum->nlist = 0;
+
+		return -1;
+	}
+
+	datum->value = datum->list[0];
+	datum->unit = datum->lunits[0];
+	datum->range = colons != 0;
+
+	if (colons != 0 && (commas != 0 || colons != 2 || datum->list[2] < 2 || datum->list[2] != (int)datum->list[2]))
+		warn(WL_info, "readdatum", "A range must be of a first and last value, and a whole number of values of at least 2; using its first value.\n"),
+		datum->nlist = 0;
+	else
+	if (datum->nlist == 1)
+	/* a list of one value is that value */
+		datum->nlist = 0;
+
+	while ((c = getc_unlocked(f)) != EOF && (r = cin(c, term)) == -1)
+		;
+
+	return c == EOF ? -1 : r;
+}
 
 int readdatum(FILE *f, const char *term, struct datum *datum)
 {
-	int c, negative = 0, i, r = -1;
-	char arr[RD_ARRSIZE];
+	int c, i, r = -1, toolong = 0, power = 0, digits = 0, point = 0, fraction = 0, negative, unit, j, k, n;
+	unsigned long long whole = 0;
+	char arr[RD_ARRSIZE], units[RD_ARRSIZE], number[RD_ARRSIZE + 16], *p, *u;
 
 	datum->value = (real)0;
 	datum->unit = 0;
+	datum->nlist = 0;
 
-	while (isspace(c = getc(f)) && (r = cin(c, term)) == -1)
+	while (isspace(c = getc_unlocked(f)) && (r = cin(c, term)) == -1)
 		;
 
 	if (r != -1)
 		return r;
 
-	if (c == '-')
-		negative = 1, c = getc(f);
-	else
-	if (c == '+')
-		c = getc(f);
+	if (c == '{')
+		return readlist(f, term, datum);
 
-	if (isalpha(c))
-	/* constant */
+	/* the number and its unit are one token, unless there are spaces between them */
+	c = readtoken(f, c, term, arr, &r, &toolong);
+	p = arr;
+
+	if (toolong)
 	{
-		i = 0;
+		warn(WL_info, "readdatum", "Datum beginning \"%a\" is too long, assuming value of 0.\n", arr);
 
-		do
-			if ((r = cin(c, term)) != -1)
-				break;
-			else
-			if (i == RD_ARRSIZE - 1)
-			{
-				while (isalpha(c = getc(f)) && (r = cin(c, term)) == -1)
-					;
+		goto readdatum_end;
+	}
 
-				break;
-			} else
-				arr[i++] = tolower(c);
-		while (isalpha(c = getc(f)));
+	negative = *p == '-';
 
-		arr[i] = '\0';
+	if (*p == '-' || *p == '+')
+		++p;
 
-		switch (arrin(arr, 5, "e", "pm", "nm", "em", "na"))
-		{
-		case -1:
-			warn(WL_info, "readdatum", "Unknown constant \"%a\" used, assuming value of 0.\n", arr);
+	if (isalpha((unsigned char)*p))
+	/* constant */
+	{
+		for (u = p; *u != '\0'; ++u)
+			*u = tolower((unsigned char)*u);
 
-			break;
+		for (k = 0; k < (int)(sizeof(constants) / sizeof(constants[0])); ++k)
+			if (strcmp(p, constants[k].name) == 0)
+				break;
 
-		case 0:  datum->value = (real)EC;              break;
-		/* mass related constants; must be defined in (g) */
-		case 1:  datum->value = (real)PM * (real)1e3;  break;
-		case 2:  datum->value = (real)NM * (real)1e3;  break;
-		case 3:  datum->value = (real)EM * (real)1e3;  break;
-		case 4:  datum->value = 0;                     break;
-		}
+		if (k == (int)(sizeof(constants) / sizeof(constants[0])))
+			warn(WL_info, "readdatum", "Unknown constant \"%a\" used, assuming value of 0.\n", p);
+		else
+			datum->value = negative ? -constants[k].value : constants[k].value;
 
-		if (negative)
-			datum->value *= (real)-1;
-	} else {
-		int x = 0, unit, j, k;
+		goto readdatum_end;
+	}
 
-		if (isdigit(c))
-		/* whole component */
-			do
-				x = (x * 10) + (c - '0');
-			while (isdigit(c = getc(f)));
+	/* the mantissa, copied as it is to be converted at once with the exponent; then the exponent */
+	for (n = 0, number[n++] = negative ? '-' : '+'; isdigit((unsigned char)*p) || (*p == '.' && !point); ++p)
+	{
+		number[n++] = *p;
 
-		datum->value = (real)x;
+		if (*p == '.')
+		{
+			point = 1;
 
-		if (c == '.')
-		/* decimal component */
-			for (x = 1; isdigit(c = getc(f)); ++x)
-				datum->value += (real)(c - '0') * powl((real)0.1, (real)x);
+			continue;
+		}
 
-		if (negative)
-			datum->value *= (real)-1;
+		/* the digits as a whole number, while it is exact; leading zeros are not counted */
+		if (whole != 0 || *p != '0')
+			++digits;
 
-		if (c == 'e')
-		/* scientific notation */
-		{
-			negative = 0;
+		if (digits <= RD_DIGITS)
+			whole = whole * 10 + (*p - '0'), fraction += point;
+	}
 
-			if ((c = getc(f)) == '-')
-				negative = 1, c = getc(f);
-			else
-			if (c == '+')
-				c = getc(f);
-			else
-			if (!isdigit(c))
-			/* mistook a unit for scientific notation */
-			{
-				ungetc(c, f);
-				c = 'e';
+	number[n] = '\0';
 
-				goto readdatum_unitspec;
-			}
+	/* an `e' not followed by the digits of an exponent begins the unit; eg., the elementary charge */
+	if ((*p == 'e' || *p == 'E')
+	 && (isdigit((unsigned char)p[1]) || ((p[1] == '-' || p[1] == '+') && isdigit((unsigned char)p[2]))))
+	{
+		negative = *++p == '-';
 
-			x = 0;
+		if (*p == '-' || *p == '+')
+			++p;
 
-			do
-				x = (x * 10) + (c - '0');
-			while (isdigit(c = getc(f)));
+		for (; isdigit((unsigned char)*p); ++p)
+			if (power < RD_EXPMAX)
+				power = power * 10 + (*p - '0');
 
-			if (negative)
-				datum->value *= (real)1 / powl((real)10, (real)x);
-			else
-				datum->value *= powl((real)10, (real)x);
-		}
+		if (negative)
+			power = -power;
+	}
 
-	readdatum_unitspec:
-		/* unit specification */
+	if (n == 1 || (n == 2 && point))
+	{
+		if (*p != '\0' || p != arr)
+			warn(WL_info, "readdatum", "No number in \"%a\", assuming value of 0.\n", arr);
 
-		while (isspace(c))
-			c = getc(f);
+		goto readdatum_end;
+	}
 
-		for (i = 0; c != EOF && !isspace(c) && (r = cin(c, term)) == -1; c = getc(f))
-			if (i < RD_ARRSIZE - 1)
-				arr[i++] = c;
-			else {
-				while (isalpha(c = getc(f)))
-					;
+	/* unit specification; either the rest of the token, or the token after the spaces that follow it */
+	strcpy(units, p);
 
-				break;
-			}
+	if (units[0] == '\0' && r == -1)
+	{
+		while (isspace(c) && (r = cin(c, term)) == -1)
+			c = getc_unlocked(f);
 
-		arr[i] = '\0';
+		if (r == -1 && c != EOF)
+			c = readtoken(f, c, term, units, &r, &toolong);
+	}
 
-		if (i == 0)
-			goto readdatum_end;
+	i = strlen(units);
 
+	if (i != 0)
+	{
 		for (unit = 0; unit < datum->nunits; ++unit)
 		{
-			j = i;
 			k = strlen(datum->units[unit]);
 
-			if (k > j)
+			if (k > i || strcmp(units + i - k, datum->units[unit]) != 0)
 				continue;
 
-			while (arr[--j] == datum->units[unit][--k] && k != 0)
-				;
+			/* unit found; with a metric multiplier before it, if any */
+			datum->unit = unit;
 
-			if (arr[j] == datum->units[unit][k])
-			/* unit found */
+			if (i - k == 1)
 			{
-				datum->unit = unit;
+				for (j = 0; j < (int)(sizeof(multipliers) / sizeof(multipliers[0])); ++j)
+					if (multipliers[j].prefix == units[0])
+						break;
 
-				if (j == 1)
-					switch (arr[0])
-					{
-					case 'P':  datum->value *= (real)1e+15;  break;
-					case 'T':  datum->value *= (real)1e+12;  break;
-					case 'G':  datum->value *= (real)1e+9;   break;
-					case 'M':  datum->value *= (real)1e+6;   break;
-					case 'k':  datum->value *= (real)1e+3;   break;
-					case 'h':  datum->value *= (real)1e+2;   break;
-					case 'd':  datum->value *= (real)1e-1;   break;
-					case 'c':  datum->value *= (real)1e-2;   break;
-					case 'm':  datum->value *= (real)1e-3;   break;
-					case 'u':  datum->value *= (real)1e-6;   break;
-					case 'n':  datum->value *= (real)1e-9;   break;
-					case 'p':  datum->value *= (real)1e-12;  break;
-					case 'f':  datum->value *= (real)1e-15;  break;
-					default:   goto readdatum_invalidmul;    break;
-					}
+				if (j < (int)(sizeof(multipliers) / sizeof(multipliers[0])))
+					power += multipliers[j].power;
 				else
-				if (j != 0)
-					goto readdatum_invalidmul;
-
-				break;
-
-			readdatum_invalidmul:
-				warn(WL_info, "readdatum", "Improper metric multiplier in \"%a\", ignoring but maintaining unit.\n", arr);
+					warn(WL_info, "readdatum", "Improper metric multiplier in \"%a\", ignoring but maintaining unit.\n", units);
+			} else
+			if (i != k)
+				warn(WL_info, "readdatum", "Improper metric multiplier in \"%a\", ignoring but maintaining unit.\n", units);
 
-				break;
-			}
+			break;
 		}
 
 		if (unit == datum->nunits)
-		/* unit not found */
-			warn(WL_info, "readdatum", "Improper unit used in \"%a\", using default unit of \"%a\" instead.\n", arr, datum->units[0]);
+			warn(WL_info, "readdatum", "Improper unit used in \"%a\", using default unit of \"%a\" instead.\n", units, datum->units[0]);
+	}
+
+	/* the value is the nearest to the datum as written, multiplier and all; when the digits and the power of ten are
+	 * both exact, that is their product or quotient, else it is left to (strtor)
+	 */
+	if (digits <= RD_DIGITS && power - fraction >= -RD_EXACT && power - fraction <= RD_EXACT)
+	{
+		datum->value = power - fraction < 0 ? (real)whole / tens[fraction - power] : (real)whole * tens[power - fraction];
+
+		if (number[0] == '-')
+			datum->value = -datum->value;
+	} else {
+		sprintf(number + n, "e%d", power);
+		datum->value = strtor(number, NULL);
 	}
+
 readdatum_end:
 
 	if (r != -1)
 		return r;
 
 	while (c != EOF && (r = cin(c, term)) == -1)
-		c = getc(f);
+		c = getc_unlocked(f);
 
 	return c == EOF ? -1 : r;
 }
@@ -455,6 +626,9 @@ void mkdatum(struct datum *datum, int nunits, ...)
 
 	datum->nunits = nunits;
 	datum->units = units;
+	datum->list = NULL;
+	datum->lunits = NULL;
+	datum->nlist = datum->size = datum->range = 0;
 
 	va_start(ap, nunits);
 
@@ -480,6 +654,7 @@ void freedata(int ndatum, ...)
 	{
 		datum = va_arg(ap, struct datum *);
 		free(datum->units);
+		free(datum->list), free(datum->lunits);
 	}
 
 	va_end(ap);
@@ -493,14 +668,92 @@ static struct object *mkobject(void)
 		warn(WL_crash, "mkobject", "malloc returned NULL.\n"),
 		exit(EXIT_FAILURE);
 
-	object->loc = V_make(0,0);
-	object->vel = V_make(0,0);
+	object->loc = V_make(0,0,0);
+	object->vel = V_make(0,0,0);
 	object->charge = (real)0;
 	object->mass = (real)0;
 
 	return object;
 }
 
+/* addsweep: Add the list or range read into (datum) to the end of the sweeps of (exp), as the values of (key), or of
+ * (field) of the object (object) if (key) is SW_system; converted into the units the experiment structure holds
+ * them in. A sweep with a value that is not valid for its key is warned of and discarded, and its first value is
+ * then read as a single datum would be, as it is for a sweep that is added.
+ */
+static void addsweep(struct exp *exp, int key, int object, int field, struct datum *datum)
+{
+	static const char *names[] = { SW_NAMES };
+	struct sweep *sweep, **tail;
+	real *values, v;
+	int i, n;
+
+	if (datum->nlist == 0)
+		return;
+
+	n = datum->range ? (int)datum->list[2] : datum->nlist;
+
+	if (exp->nruns > INT_MAX / n)
+	{
+		warn(WL_warn, "readexp", "Too many runs in the sweeps of the experiment, discarding a sweep.\n");
+
+		return;
+	}
+
+	if ((sweep = malloc(sizeof(struct sweep))) == NULL || (values = malloc(n * sizeof(real))) == NULL)
+		warn(WL_crash, "readexp", "malloc returned NULL when attempting allocation of a sweep.\n"),
+		exit(EXIT_FAILURE);
+
+	for (i = 0; i < (datum->range ? 2 : n); ++i)
+	{
+		v = datum->list[i];
+
+		if (key == SW_system && field == 2 * DIM && datum->lunits[i] == 1)
+		/* e -> C */
+			v *= EC;
+		else
+		if (key == SW_system && field == 2 * DIM + 1)
+		/* u -> kg, or g -> kg */
+			v *= datum->lunits[i] == 1 ? AMU : 1e-3;
+
+		values[i] = v;
+	}
+
+	if (datum->range)
+	/* evenly spaced, ending at the last value exactly */
+		for (v = values[1], i = 1; i < n; ++i)
+			values[i] = i == n - 1 ? v : values[0] + (v - values[0]) * i / (n - 1);
+
+	for (i = 0; i < n; ++i)
+		if ((key == SW_delta && values[i] <= 0)
+		 || (key == SW_limit && ceil(values[i]) < 1)
+		 || (key == SW_theta && values[i] <= 0)
+		 || (key == SW_order && (values[i] < 0 || values[i] > FMM_MAXORDER || values[i] != (int)values[i]))
+		 || (key == SW_mesh && !PM_valid(values[i]))
+		 || (key == SW_tolerance && values[i] <= 0)
+		 || ((key == SW_softening || key == SW_encounter || key == SW_cutoff || key == SW_screening) && values[i] < 0))
+		{
+			warn(WL_warn, "readexp", "Value %e of the sweep of %a is not valid, discarding the sweep.\n",
+			    (long double)values[i], key == SW_system ? "an object" : names[key]);
+			free(values), free(sweep);
+
+			return;
+		}
+
+	sweep->key = key;
+	sweep->object = object;
+	sweep->field = field;
+	sweep->values = values;
+	sweep->nvalues = n;
+	sweep->next = NULL;
+
+	for (tail = &exp->sweep; *tail != NULL; tail = &(*tail)->next)
+		;
+
+	*tail = sweep;
+	exp->nruns *= n;
+}
+
 #define RE_KEYSIZE  32
 #define RE_WARNEOF  "Unexpected end of file.\n"
 
@@ -511,23 +764,38 @@ int readexp(const char *path, struct exp *exp)
 	int c, x, i, r;
 	char key[RE_KEYSIZE];
 	struct object *node;
-	struct datum time, limit, locx, locy, velx, vely, charge, mass;
+	char name[RE_KEYSIZE], file[exp_PATHSIZE];
+	const char *slash;
+	struct datum time, limit, theta, order, tolerance, softening, encounter, cutoff, screening, width, height, D3(depth,) mesh;
+	struct datum locx, locy, D3(locz,) velx, vely, D3(velz,) charge, mass;
 
-	stat(path, &statbuf);
-
-	if (!S_ISREG(statbuf.st_mode)
+	if (stat(path, &statbuf) != 0
+	 || !S_ISREG(statbuf.st_mode)
 	 || (f = fopen(path, "r")) == NULL)
 	/* check if file is regular, and if it has been opened properly */
 		return 0;
 
 	mkdatum(&locx, 1, "m");
 	mkdatum(&locy, 1, "m");
+	D3(mkdatum(&locz, 1, "m");)
 	mkdatum(&velx, 1, "m/s");
 	mkdatum(&vely, 1, "m/s");
+	D3(mkdatum(&velz, 1, "m/s");)
 	mkdatum(&charge, 2, "C", "e");
 	mkdatum(&mass, 2, "g", "u");
 	mkdatum(&time, 1, "s");
 	mkdatum(&limit, 1, "fr.");
+	mkdatum(&theta, 1, "");
+	mkdatum(&order, 1, "");
+	mkdatum(&tolerance, 1, "");
+	mkdatum(&softening, 1, "m");
+	mkdatum(&encounter, 1, "m");
+	mkdatum(&cutoff, 1, "m");
+	mkdatum(&screening, 1, "m");
+	mkdatum(&width, 1, "m");
+	mkdatum(&height, 1, "m");
+	D3(mkdatum(&depth, 1, "m");)
+	mkdatum(&mesh, 1, "");
 
 	strcpy(exp->path, path);
 
@@ -559,7 +827,8 @@ int readexp(const char *path, struct exp *exp)
 			goto readexp_end;
 		}
 
-		switch (arrin(key, 4, "title", "delta", "limit", "system"))
+		switch (arrin(key, 17, "title", "delta", "limit", "system", "routine", "theta", "order", "integrator", "timestep",
+		             "tolerance", "softening", "encounter", "system_file", "cutoff", "screening", "box", "mesh"))
 		{
 		case -1:
 			warn(WL_warn, "readexp", "Key \"%a\" is not known, skipping.\n", key);
@@ -586,6 +855,8 @@ int readexp(const char *path, struct exp *exp)
 				goto readexp_end;
 			}
 
+			addsweep(exp, SW_delta, 0, 0, &time);
+
 			if (time.value > 0)
 				exp->delta = time.value;
 			else
@@ -602,6 +873,8 @@ int readexp(const char *path, struct exp *exp)
 				goto readexp_end;
 			}
 
+			addsweep(exp, SW_limit, 0, 0, &limit);
+
 			x = ceil(limit.value);
 
 			if (x > 0)
@@ -613,6 +886,13 @@ int readexp(const char *path, struct exp *exp)
 
 		case 3:
 		/* system */
+			if (exp->system != NULL || exp->source.map != NULL)
+			{
+				warn(WL_warn, "readexp", "System is given more than once, discarding.\n");
+
+				goto readexp_skip;
+			}
+
 			while (isspace(c = getc(f)))
 				;
 
@@ -630,13 +910,24 @@ int readexp(const char *path, struct exp *exp)
 
 			for (exp->nobjects = 1;; ++exp->nobjects)
 			{
-				x = readdata(f, ",#\n;", 6, &locx, &locy, &velx, &vely, &charge, &mass);
+				x = readdata(f, ",#\n;", SF_COLUMNS, &locx, &locy, D3(&locz,) &velx, &vely, D3(&velz,) &charge, &mass);
+
+				addsweep(exp, SW_system, exp->nobjects - 1, 0, &locx);
+				addsweep(exp, SW_system, exp->nobjects - 1, 1, &locy);
+				D3(addsweep(exp, SW_system, exp->nobjects - 1, 2, &locz);)
+				addsweep(exp, SW_system, exp->nobjects - 1, DIM, &velx);
+				addsweep(exp, SW_system, exp->nobjects - 1, DIM + 1, &vely);
+				D3(addsweep(exp, SW_system, exp->nobjects - 1, 5, &velz);)
+				addsweep(exp, SW_system, exp->nobjects - 1, 2 * DIM, &charge);
+				addsweep(exp, SW_system, exp->nobjects - 1, 2 * DIM + 1, &mass);
 
 				node->loc.x = locx.value;
 				node->loc.y = locy.value;
+				D3(node->loc.z = locz.value;)
 
 				node->vel.x = velx.value;
 				node->vel.y = vely.value;
+				D3(node->vel.z = velz.value;)
 
 				if (charge.unit == 1)
 				/* e -> C */
@@ -709,257 +1000,2391 @@ int readexp(const char *path, struct exp *exp)
 			node->next = NULL;
 
 			break;
-		}
 
-		continue;
+		case 4:
+		/* routine */
+			if (readarr(f, ";", name, RE_KEYSIZE) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
 
-	readexp_skip:
+				goto readexp_end;
+			}
 
-		while ((c = getc(f)) != ';' && c != EOF)
-			if (c == '#')
-				while ((c = getc(f)) != '\n' && c != EOF)
-					;
+			if ((x = arrin(name, 7, "direct", "barnes-hut", "symmetric", "fmm", "cutoff", "ewald", "pm")) != -1)
+				exp->routine = x;
+			else
+				warn(WL_warn, "readexp", "Routine \"%a\" is not known, discarding.\n", name);
 
-		if (c == EOF)
 			break;
 
-		continue;
-	}
-readexp_end:
-
-	r = 1;
+		case 5:
+		/* theta */
+			if (readdatum(f, ";", &theta) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
 
-	if (exp->system == NULL)
-		warn(WL_fail, "readexp", "System is empty.\n"), r = 0;
+				goto readexp_end;
+			}
 
-	if (exp->title[0] == '\0')
-		warn(WL_fail, "readexp", "Delta is unset.\n"), r = 0;
+			addsweep(exp, SW_theta, 0, 0, &theta);
 
-	if (exp->delta == (real)0)
-		warn(WL_fail, "readexp", "Delta is unset.\n"), r = 0;
+			if (theta.value > 0)
+				exp->theta = theta.value;
+			else
+				warn(WL_warn, "readexp", "Theta value is less than or equal to zero, discarding.\n");
 
-	if (exp->limit == 0)
-		warn(WL_fail, "readexp", "Limit is unset.\n"), r = 0;
+			break;
 
-	return r;
-}
+		case 6:
+		/* order */
+			if (readdatum(f, ";", &order) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
 
-void freeexp(struct exp *exp)
-{
-	struct object *node, *nextn;
-	struct frame *frame, *nextf;
+				goto readexp_end;
+			}
 
-	for (node = exp->system; node != NULL; node = nextn)
-		nextn = node->next, free(node);
+			addsweep(exp, SW_order, 0, 0, &order);
 
-	for (frame = exp->frame; frame != NULL; frame = nextf)
-	{
-		nextf = frame->next;
-		free(frame->system);
-		free(frame);
-	}
-}
+			if (order.value >= 0 && order.value <= FMM_MAXORDER && order.value == (int)order.value)
+				exp->order = (int)order.value;
+			else
+				warn(WL_warn, "readexp", "Order is not a whole number from 0 up to %i, discarding.\n", FMM_MAXORDER);
 
-int initexp(struct exp *exp)
-{
-	struct frame *frame;
+			break;
 
-	if ((frame = malloc(sizeof(struct frame))) == NULL
-	 || (frame->system = calloc(exp->nobjects, sizeof(struct snapshot))) == NULL)
-	{
-		warn(WL_crash, "initexp", "(malloc|calloc) returned NULL after attempting to allocate memory for a frame.\n");
+		case 7:
+		/* integrator */
+			if (readarr(f, ";", name, RE_KEYSIZE) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
 
-		return 0;
-	}
+				goto readexp_end;
+			}
 
-	int i;
-	struct object *o;
+			if ((x = arrin(name, 4, "euler", "verlet", "yoshida", "rk4")) != -1)
+				exp->integrator = x;
+			else
+				warn(WL_warn, "readexp", "Integrator \"%a\" is not known, discarding.\n", name);
 
-	for (i = 0, o = exp->system; i < exp->nobjects; ++i, o = o->next)
-		frame->system[i].loc = o->loc, frame->system[i].vel = o->vel;
+			break;
 
-	exp->frame = frame;
+		case 8:
+		/* timestep */
+			if (readarr(f, ";", name, RE_KEYSIZE) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
 
-	return 1;
-}
+				goto readexp_end;
+			}
 
-static int mkframe(struct exp *exp, struct frame *frame)
-{
-	struct frame *next;
-	int i, j;
-	struct object *o, *p;
-	vector radius;
-	real rsquared;
+			if ((x = arrin(name, 3, "fixed", "adaptive", "block")) != -1)
+				exp->timestep = x;
+			else
+				warn(WL_warn, "readexp", "Time step \"%a\" is not known, discarding.\n", name);
 
-	if ((next = malloc(sizeof(struct frame))) == NULL
-	 || (next->system = calloc(exp->nobjects, sizeof(struct snapshot))) == NULL)
-	{
-		warn(WL_crash, "mkframe", "(malloc|calloc) returned NULL when attempting allocation of frame.\n");
+			break;
 
-		return 0;
-	}
+		case 9:
+		/* tolerance */
+			if (readdatum(f, ";", &tolerance) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
 
-	frame->next = next;
+				goto readexp_end;
+			}
 
-	/* routine */
-	for (i = 0, o = exp->system; i < exp->nobjects; ++i, o = o->next)
-	{
-		/* initialize felec and fgrav vectors */
-		frame->system[i].felec = V_make(0,0);
-		frame->system[i].fgrav = V_make(0,0);
+			addsweep(exp, SW_tolerance, 0, 0, &tolerance);
 
-		for (j = 0, p = exp->system; j < exp->nobjects; ++j, p = p->next)
-		{
-			if (j == i)
-			/* do not calculate force on an object from itself */
-				continue;
+			if (tolerance.value > 0)
+				exp->tolerance = tolerance.value;
+			else
+				warn(WL_warn, "readexp", "Tolerance is less than or equal to zero, discarding.\n");
 
-			/* The radius vector is a line connecting object (o) to object
-			 * (p), with the direction from object (o) towards (p). */
-			radius = V_sub(frame->system[j].loc, frame->system[i].loc);
-			rsquared = powl(V_get(radius), 2);
+			break;
 
-			/* Electrostatic force is a repulsive force (on like-charges), thus (V_sub). */
-			frame->system[i].felec = V_sub(frame->system[i].felec, V_set(radius, p->charge / rsquared));
-			/* Gravitational force is an attractive force, thus (V_add). */
-			frame->system[i].fgrav = V_add(frame->system[i].fgrav, V_set(radius, p->mass / rsquared));
-		}
+		case 10:
+		/* softening */
+			if (readdatum(f, ";", &softening) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
 
-		frame->system[i].felec = V_mul(frame->system[i].felec, K * o->charge);
-		frame->system[i].fgrav = V_mul(frame->system[i].fgrav, G * o->mass);
-		frame->system[i].acc = V_div(V_add(frame->system[i].felec, frame->system[i].fgrav), o->mass);
+				goto readexp_end;
+			}
 
-		next->system[i].vel = V_add(frame->system[i].vel, V_mul(frame->system[i].acc, exp->delta));
-		next->system[i].loc = V_add(frame->system[i].loc, V_mul(next->system[i].vel, exp->delta));
-	}
+			addsweep(exp, SW_softening, 0, 0, &softening);
 
-	return 1;
-}
+			if (softening.value >= 0)
+				exp->softening = softening.value;
+			else
+				warn(WL_warn, "readexp", "Softening is less than zero, discarding.\n");
 
-void *compiler(void *arg)
-{
-	struct exp *exp = (struct exp *)arg;
-	struct frame *frame;
+			break;
 
-	warn(WL_verbose, "compiler", "Initialized.\n");
+		case 11:
+		/* encounter */
+			if (readdatum(f, ";", &encounter) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
 
-	for (frame = exp->frame; readmutexint(&threads_run); frame = frame->next)
+				goto readexp_end;
+			}
+
+			addsweep(exp, SW_encounter, 0, 0, &encounter);
+
+			if (encounter.value >= 0)
+				exp->encounter = encounter.value;
+			else
+				warn(WL_warn, "readexp", "Encounter distance is less than zero, discarding.\n");
+
+			break;
+
+		case 12:
+		/* system_file; a relative path is put after the directory of the experiment file */
+			x = (slash = strrchr(path, '/')) == NULL ? 0 : (int)(slash + 1 - path);
+			memcpy(file, path, x);
+
+			if (readarr(f, ";", file + x, exp_PATHSIZE - x) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
+
+				goto readexp_end;
+			}
+
+			/* without the spaces before the `;' */
+			for (i = strlen(file); i > x && isspace(file[i - 1]); --i)
+				file[i - 1] = '\0';
+
+			if (file[x] == '/')
+				memmove(file, file + x, strlen(file + x) + 1);
+
+			if (exp->system != NULL || exp->source.map != NULL)
+				warn(WL_warn, "readexp", "System is given more than once, discarding.\n");
+			else
+				mapsystem(file, exp);
+
+			break;
+
+		case 13:
+		/* cutoff */
+			if (readdatum(f, ";", &cutoff) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
+
+				goto readexp_end;
+			}
+
+			addsweep(exp, SW_cutoff, 0, 0, &cutoff);
+
+			if (cutoff.value >= 0)
+				exp->cutoff = cutoff.value;
+			else
+				warn(WL_warn, "readexp", "Cutoff is less than zero, discarding.\n");
+
+			break;
+
+		case 14:
+		/* screening */
+			if (readdatum(f, ";", &screening) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
+
+				goto readexp_end;
+			}
+
+			addsweep(exp, SW_screening, 0, 0, &screening);
+
+			if (screening.value >= 0)
+				exp->screening = screening.value;
+			else
+				warn(WL_warn, "readexp", "Screening length is less than zero, discarding.\n");
+
+			break;
+
+		case 15:
+		/* box; a square if only its width is given */
+#if DIM == 3
+		/* or a cube, in three dimensions; (i) is if its height is followed by its depth */
+			if ((x = readdatum(f, ",;", &width)) == -1
+			 || (x == 0 && (i = readdatum(f, ",;", &height)) == -1)
+			 || (x == 0 && i == 0 && readdatum(f, ";", &depth) == -1))
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
+
+				goto readexp_end;
+			}
+
+			if (x == 0 && i == 1)
+			{
+				warn(WL_warn, "readexp", "Box is given by two data, rather than by one or three, discarding.\n");
+
+				break;
+			}
+
+			if (x == 1)
+				height.value = depth.value = width.value;
+
+			if (width.nlist != 0 || (x == 0 && (height.nlist != 0 || depth.nlist != 0)))
+				warn(WL_warn, "readexp", "Box may not be swept over, using its first values.\n");
+
+			if (width.value > 0 && height.value > 0 && depth.value > 0)
+				exp->box = V_make(width.value, height.value, depth.value);
+			else
+				warn(WL_warn, "readexp", "Box is not larger than zero, discarding.\n");
+#else
+			if ((x = readdatum(f, ",;", &width)) == -1 || (x == 0 && readdatum(f, ";", &height) == -1))
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
+
+				goto readexp_end;
+			}
+
+			if (x == 1)
+				height.value = width.value;
+
+			if (width.nlist != 0 || (x == 0 && height.nlist != 0))
+				warn(WL_warn, "readexp", "Box may not be swept over, using its first values.\n");
+
+			if (width.value > 0 && height.value > 0)
+				exp->box = V_make(width.value, height.value, 0);
+			else
+				warn(WL_warn, "readexp", "Box is not larger than zero, discarding.\n");
+#endif
+
+			break;
+
+		case 16:
+		/* mesh */
+			if (readdatum(f, ";", &mesh) == -1)
+			{
+				warn(WL_info, "readexp", RE_WARNEOF);
+
+				goto readexp_end;
+			}
+
+			addsweep(exp, SW_mesh, 0, 0, &mesh);
+
+			if (PM_valid(mesh.value))
+				exp->mesh = (int)mesh.value;
+			else
+				warn(WL_warn, "readexp", "Mesh is not a power of two from %i up to %i, discarding.\n", PM_MINMESH, PM_MAXMESH);
+
+			break;
+		}
+
+		continue;
+
+	readexp_skip:
+
+		while ((c = getc(f)) != ';' && c != EOF)
+			if (c == '#')
+				while ((c = getc(f)) != '\n' && c != EOF)
+					;
+
+		if (c == EOF)
+			break;
+
+		continue;
+	}
+readexp_end:
+
+	fclose(f);
+	freedata(18 D3(+ 3), &locx, &locy, D3(&locz,) &velx, &vely, D3(&velz,) &charge, &mass, &time, &limit, &theta, &order,
+	    &tolerance, &softening, &encounter, &cutoff, &screening, &width, &height, D3(&depth,) &mesh);
+
+	r = 1;
+
+	if (exp->system == NULL && exp->source.map == NULL)
+		warn(WL_fail, "readexp", "System is empty.\n"), r = 0;
+
+	if (exp->title[0] == '\0')
+		warn(WL_fail, "readexp", "Delta is unset.\n"), r = 0;
+
+	if (exp->delta == (real)0)
+		warn(WL_fail, "readexp", "Delta is unset.\n"), r = 0;
+
+	if (exp->limit == 0)
+		warn(WL_fail, "readexp", "Limit is unset.\n"), r = 0;
+
+	return r;
+}
+
+/* significant bytes of the real type, as written in binary output */
+#if !defined(PRECISION_float) && !defined(PRECISION_double) && LDBL_MANT_DIG == 64
+#define B_REALSIZE  10
+#else
+#define B_REALSIZE  sizeof(real)
+#endif
+
+void mkexp(struct exp *exp)
+{
+	exp->title[0] = '\0';
+	exp->path[0] = '\0';
+	exp->delta = (real)0;
+	exp->limit = 0;
+	exp->begin = 1;
+	exp->binary = 0;
+	exp->realsize = B_REALSIZE;
+	exp->fields = F_all;
+	exp->nfields = 0;
+	exp->stride = 1;
+	exp->routine = RT_direct;
+	exp->theta = (real)0.5;
+	exp->order = FMM_ORDER;
+	exp->mesh = 0;
+	exp->softening = (real)0;
+	exp->integrator = IN_euler;
+	exp->timestep = TS_fixed;
+	exp->tolerance = (real)1e-3;
+	exp->encounter = (real)0;
+	exp->cutoff = (real)0;
+	exp->screening = (real)0;
+	exp->box = V_make(0,0,0);
+	exp->system = NULL;
+	exp->nobjects = 0;
+	exp->sweep = NULL;
+	exp->nruns = 1;
+	exp->source.map = NULL;
+	exp->frame = NULL;
+	exp->out = stdout;
+	memset(&exp->stats, 0, sizeof(struct stats));
+	exp->tree.cells = NULL;
+	exp->tree.ncells = exp->tree.size = 0;
+	exp->tree.next = NULL;
+	exp->lists.start = NULL;
+	exp->lists.index = NULL;
+	exp->lists.x0 = NULL;
+	exp->lists.sorted = NULL;
+	exp->lists.cell = NULL;
+	exp->lists.size = exp->lists.columns = exp->lists.rows = 0;
+	exp->lists.built = 0;
+	exp->lists.builds = 0;
+	exp->fmm.start = exp->fmm.index = exp->fmm.leaf = NULL;
+	exp->fmm.x = exp->fmm.y = exp->fmm.charge = exp->fmm.mass = NULL;
+	D3(exp->fmm.z = NULL;)
+	exp->fmm.multipole = exp->fmm.local = exp->fmm.m2m = exp->fmm.l2l = exp->fmm.derivs = NULL;
+	exp->fmm.terms = NULL;
+	exp->fmm.exponents = NULL;
+	exp->fmm.order = -1;
+	exp->ewald.split = (real)EW_SPLIT;
+	exp->ewald.weight = exp->ewald.phases = NULL;
+	exp->ewald.span = NULL;
+	exp->ewald.nworkers = 0;
+	exp->ewald.madefor[0] = -1;
+	exp->pm.fx = exp->pm.rho = exp->pm.green = NULL;
+	D3(exp->pm.fz = NULL;)
+	exp->pm.twiddles = exp->pm.column = NULL;
+	exp->pm.nworkers = 0;
+	exp->pm.madefor[0] = -1;
+	exp->particles.x = NULL;
+	exp->particles.x0 = NULL;
+	exp->particles.save = NULL;
+	exp->particles.ax = NULL;
+	exp->particles.level = NULL;
+	exp->particles.partner = NULL;
+	exp->pool.nthreads = 1;
+	exp->pool.threads = NULL;
+	exp->pool.pull = NULL;
+	exp->checkpoint.path[0] = '\0';
+	exp->checkpoint.every = 0;
+	exp->checkpoint.state = NULL;
+	exp->checkpoint.running = 0;
+}
+
+void freeexp(struct exp *exp)
+{
+	struct object *node, *nextn;
+
+	for (node = exp->system; node != NULL; node = nextn)
+		nextn = node->next, free(node);
+
+	/* the system of the first frame owns the memory of every frame's system */
+	if (exp->frame != NULL)
+		free(exp->frame[0].system), free(exp->frame);
+
+	/* (x) owns the memory of every array in the particles structure */
+	free(exp->particles.x);
+	free(exp->particles.x0);
+	free(exp->particles.save);
+	free(exp->particles.ax), free(exp->particles.level);
+	free(exp->particles.partner);
+	freetree(&exp->tree);
+	freelists(&exp->lists);
+	freefmm(&exp->fmm);
+	freeewald(&exp->ewald);
+	freepm(&exp->pm);
+	free(exp->checkpoint.state);
+	unmapsystem(&exp->source);
+	freesweep(exp->sweep);
+
+	if (exp->pool.pull != NULL)
+		free(exp->pool.pull[0].qx), free(exp->pool.pull);
+}
+
+void freesweep(struct sweep *sweep)
+{
+	struct sweep *next;
+
+	for (; sweep != NULL; sweep = next)
+		next = sweep->next, free(sweep->values), free(sweep);
+}
+
+int initexp(struct exp *exp)
+{
+	struct particles *P = &exp->particles;
+	size_t size;
+	real *arr;
+	int k;
+
+	if (exp->routine == RT_cutoff && exp->cutoff == 0)
+	{
+		warn(WL_fail, "initexp", "Cutoff is unset, and the cutoff routine needs it.\n");
+
+		return 0;
+	}
+
+	if (exp->screening != 0 && exp->routine != RT_direct && exp->routine != RT_cutoff)
+	{
+		warn(WL_fail, "initexp", "Forces are only screened by the direct and cutoff routines.\n");
+
+		return 0;
+	}
+
+	if (exp->routine == RT_ewald && exp->box.x == 0)
+	{
+		warn(WL_fail, "initexp", "Box is unset, and the ewald routine needs it.\n");
+
+		return 0;
+	}
+
+	if (exp->box.x != 0 && exp->routine != RT_cutoff && exp->routine != RT_ewald && exp->routine != RT_pm)
+	{
+		warn(WL_fail, "initexp", "Periodic boxes are only handled by the cutoff, ewald and pm routines.\n");
+
+		return 0;
+	}
+
+	if (exp->cutoff != 0 && exp->routine != RT_cutoff && exp->routine != RT_ewald && exp->routine != RT_pm)
+		warn(WL_warn, "initexp", "Cutoff is only used by the cutoff, ewald and pm routines, ignoring.\n");
+
+	if (exp->routine == RT_ewald && exp->cutoff == 0)
+		exp->cutoff = ewaldcutoff(exp);
+
+	/* only the nearest image of an object may be within the lists of another */
+	if (exp->box.x != 0 && 2 * exp->cutoff * (1 + CU_SKIN) > V_least(exp->box))
+	{
+		warn(WL_fail, "initexp", "Cutoff of %e, with the skin of the lists, is more than half of the box.\n",
+		    (long double)exp->cutoff);
+
+		return 0;
+	}
+
+	/* the motion of a pair is solved for forces that are neither screened nor cut off, in open space, and summed
+	 * exactly */
+	if (exp->encounter != 0 && (exp->screening != 0 || exp->box.x != 0 || exp->routine == RT_pm
+	 || (exp->routine == RT_cutoff && exp->encounter > exp->cutoff)))
+	{
+		warn(WL_warn, "initexp", "Encounters are not handled with screening, beyond the cutoff, in a box, or by the pm routine; discarding the encounter distance.\n");
+		exp->encounter = 0;
+	}
+
+	for (k = 0, exp->nfields = 0; k < F_COUNT; ++k)
+		exp->nfields += (exp->fields >> k) & 1;
+
+	size = (size_t)exp->nobjects * exp->nfields;
+
+	/* memory is only allocated once; an experiment structure initialized again, for the next run of a sweep, keeps
+	 * what it has, as the number of objects, the fields, the integrator and the time steps are the same in every
+	 * run, and only what is new to it is allocated */
+
+	/* there is nothing to hold if no fields are rendered */
+	if (exp->frame == NULL
+	 && ((exp->frame = malloc(R_toofar * sizeof(struct frame))) == NULL
+	  || ((exp->frame[0].system = size == 0 ? NULL : calloc(R_toofar * size, sizeof(vector))) == NULL && size != 0)))
+	{
+		warn(WL_crash, "initexp", "(malloc|calloc) returned NULL after attempting to allocate memory for the frames.\n");
+
+		return 0;
+	}
+
+	for (k = 1; k < R_toofar; ++k)
+		exp->frame[k].system = size == 0 ? NULL : exp->frame[0].system + k * size;
+
+	if (P->x == NULL)
+	{
+		if ((arr = malloc((4 * DIM + 2) * exp->nobjects * sizeof(real))) == NULL)
+		{
+			warn(WL_crash, "initexp", "malloc returned NULL after attempting to allocate memory for the particles.\n");
+
+			return 0;
+		}
+
+		P->x = arr;
+		P->y = (arr += exp->nobjects);
+		D3(P->z = (arr += exp->nobjects);)
+		P->vx = (arr += exp->nobjects);
+		P->vy = (arr += exp->nobjects);
+		D3(P->vz = (arr += exp->nobjects);)
+		P->charge = (arr += exp->nobjects);
+		P->mass = (arr += exp->nobjects);
+		P->fex = (arr += exp->nobjects);
+		P->fey = (arr += exp->nobjects);
+		D3(P->fez = (arr += exp->nobjects);)
+		P->fgx = (arr += exp->nobjects);
+		P->fgy = (arr += exp->nobjects);
+		D3(P->fgz = (arr += exp->nobjects);)
+	}
+
+	P->fresh = 0;
+	exp->lists.built = 0;
+
+	if (exp->integrator == IN_rk4 && P->x0 == NULL)
+	{
+		if ((arr = malloc(4 * DIM * exp->nobjects * sizeof(real))) == NULL)
+		{
+			warn(WL_crash, "initexp", "malloc returned NULL after attempting to allocate memory for the rk4 integrator.\n");
+
+			return 0;
+		}
+
+		P->x0 = arr;
+		P->y0 = (arr += exp->nobjects);
+		D3(P->z0 = (arr += exp->nobjects);)
+		P->vx0 = (arr += exp->nobjects);
+		P->vy0 = (arr += exp->nobjects);
+		D3(P->vz0 = (arr += exp->nobjects);)
+		P->dx = (arr += exp->nobjects);
+		P->dy = (arr += exp->nobjects);
+		D3(P->dz = (arr += exp->nobjects);)
+		P->dvx = (arr += exp->nobjects);
+		P->dvy = (arr += exp->nobjects);
+		D3(P->dvz = (arr += exp->nobjects);)
+	}
+
+	if (exp->timestep == TS_adaptive)
+	{
+		if (P->save == NULL && (P->save = malloc(4 * DIM * exp->nobjects * sizeof(real))) == NULL)
+		{
+			warn(WL_crash, "initexp", "malloc returned NULL after attempting to allocate memory for adaptive time steps.\n");
+
+			return 0;
+		}
+
+		P->h = exp->delta;
+	}
+
+	if (exp->timestep == TS_block)
+	{
+		if (P->ax == NULL)
+		{
+			if ((arr = malloc(2 * DIM * exp->nobjects * sizeof(real))) == NULL
+			 || (P->level = malloc(2 * exp->nobjects * sizeof(int))) == NULL)
+			{
+				warn(WL_crash, "initexp", "malloc returned NULL after attempting to allocate memory for block time steps.\n");
+				free(arr);
+
+				return 0;
+			}
+
+			P->ax = arr;
+			P->ay = (arr += exp->nobjects);
+			D3(P->az = (arr += exp->nobjects);)
+			P->jx = (arr += exp->nobjects);
+			P->jy = (arr += exp->nobjects);
+			D3(P->jz = (arr += exp->nobjects);)
+			P->active = P->level + exp->nobjects;
+		}
+
+		P->level[0] = -1;
+
+		if (exp->integrator == IN_yoshida || exp->integrator == IN_rk4)
+			warn(WL_warn, "initexp", "Block time steps are always taken with the verlet integrator, ignoring the integrator.\n");
+
+		if (exp->encounter > 0)
+			warn(WL_warn, "initexp", "Encounters are not handled with block time steps, ignoring the encounter distance.\n"),
+			exp->encounter = (real)0;
+	}
+
+	if (exp->encounter > 0)
+	{
+		if (P->partner == NULL)
+		{
+			/* at least twice as many lists as objects, so that few cells share one */
+			for (P->nhead = 1; P->nhead < 2 * exp->nobjects; P->nhead *= 2)
+				;
+
+			if ((P->partner = malloc((3 * exp->nobjects + P->nhead) * sizeof(int))) == NULL)
+			{
+				warn(WL_crash, "initexp", "malloc returned NULL after attempting to allocate memory for encounters.\n");
+
+				return 0;
+			}
+
+			P->nearest = P->partner + exp->nobjects;
+			P->chain = P->nearest + exp->nobjects;
+			P->head = P->chain + exp->nobjects;
+		}
+
+		if (exp->integrator == IN_yoshida || exp->integrator == IN_rk4)
+			warn(WL_warn, "initexp", "Steps with encounters are always taken as the verlet integrator does, ignoring the integrator.\n");
+	}
+
+	int i;
+	struct object *o, *next;
+
+	if (simd() != NULL)
+		warn(WL_verbose, "initexp", "Using %a instructions for the direct routine.\n", simd());
+
+	/* a system file is read straight into the particles structure */
+	if (exp->source.map != NULL)
+		return loadsystem(exp);
+
+	/* without either, as for the runs of a sweep, the particles are filled by the caller */
+	if (exp->system == NULL)
+		return 1;
+
+	/* move the system into the particles structure; it is not needed after this */
+	for (i = 0, o = exp->system; i < exp->nobjects; ++i, o = next)
+	{
+		P->x[i] = o->loc.x, P->y[i] = o->loc.y D3(, P->z[i] = o->loc.z);
+		P->vx[i] = o->vel.x, P->vy[i] = o->vel.y D3(, P->vz[i] = o->vel.z);
+		P->charge[i] = o->charge, P->mass[i] = o->mass;
+
+		next = o->next;
+		free(o);
+	}
+
+	exp->system = NULL;
+
+	return 1;
+}
+
+/* worker: argument of a worker thread */
+struct worker
+{
+	struct exp *exp;
+	int index;
+};
+
+/* range of objects that worker (_w) of (_n) works over */
+#define P_from(_exp, _w, _n)  (int)((long)(_exp)->nobjects * (_w) / (_n))
+
+static void *worker(void *arg)
+{
+	struct worker *w = (struct worker *)arg;
+	struct pool *pool = &w->exp->pool;
+
+	for (;;)
+	{
+		/* wait for a job */
+		waitbarrier(&pool->barrier);
+
+		if (pool->quit)
+			break;
+
+		if (pool->byworker)
+			pool->job(w->exp, w->index, pool->nthreads);
+		else
+			pool->job(w->exp, P_from(w->exp, w->index, pool->nthreads), P_from(w->exp, w->index + 1, pool->nthreads));
+
+		/* finished the job */
+		waitbarrier(&pool->barrier);
+	}
+
+	free(w);
+
+	return NULL;
+}
+
+void parallel(struct exp *exp, void (*job)(struct exp *exp, int from, int to))
+{
+	struct pool *pool = &exp->pool;
+
+	if (pool->threads == NULL)
+	{
+		job(exp, 0, exp->nobjects);
+
+		return;
+	}
+
+	pool->job = job;
+	pool->byworker = 0;
+	waitbarrier(&pool->barrier);
+	job(exp, 0, P_from(exp, 1, pool->nthreads));
+	waitbarrier(&pool->barrier);
+}
+
+void everyworker(struct exp *exp, void (*job)(struct exp *exp, int worker, int nworkers))
+{
+	struct pool *pool = &exp->pool;
+
+	if (pool->threads == NULL)
+	{
+		job(exp, 0, 1);
+
+		return;
+	}
+
+	pool->job = job;
+	pool->byworker = 1;
+	waitbarrier(&pool->barrier);
+	job(exp, 0, pool->nthreads);
+	waitbarrier(&pool->barrier);
+}
+
+int mkpool(struct exp *exp)
+{
+	struct pool *pool = &exp->pool;
+	struct worker *w;
+	int i, pthreadr;
+
+	if (pool->nthreads < 2)
+		return 1;
+
+	if ((pool->threads = calloc(pool->nthreads - 1, sizeof(pthread_t))) == NULL)
+	{
+		warn(WL_crash, "mkpool", "calloc returned NULL.\n");
+
+		return 0;
+	}
+
+	initbarrier(&pool->barrier, pool->nthreads);
+	pool->quit = 0;
+
+	for (i = 1; i < pool->nthreads; ++i)
+	{
+		if ((w = malloc(sizeof(struct worker))) == NULL)
+		{
+			warn(WL_crash, "mkpool", "malloc returned NULL.\n");
+
+			break;
+		}
+
+		w->exp = exp;
+		w->index = i;
+
+		if ((pthreadr = pthread_create(&pool->threads[i - 1], NULL, worker, (void *)w)))
+		{
+			warn(WL_crash, "mkpool", "Could not create worker %i, (pthread_create) returned %i.\n", i, pthreadr);
+			free(w);
+
+			break;
+		}
+	}
+
+	if (i < pool->nthreads)
+	/* stop the workers that were created */
+	{
+		pool->barrier.nthreads = i;
+		pool->nthreads = i;
+		freepool(exp);
+
+		return 0;
+	}
+
+	warn(WL_verbose, "mkpool", "Started %i workers.\n", pool->nthreads);
+
+	return 1;
+}
+
+void freepool(struct exp *exp)
+{
+	struct pool *pool = &exp->pool;
+	int i;
+
+	if (pool->threads == NULL)
+		return;
+
+	pool->quit = 1;
+	waitbarrier(&pool->barrier);
+
+	for (i = 1; i < pool->nthreads; ++i)
+		pthread_join(pool->threads[i - 1], NULL);
+
+	freebarrier(&pool->barrier);
+	free(pool->threads);
+	pool->threads = NULL;
+}
+
+void direct(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	int i, j, n = exp->nobjects;
+	real rx, ry, D3(rz,) rsquared, s, w, qx, qy, D3(qz,) mx, my, D3(mz,) e2 = exp->softening * exp->softening;
+	real l = exp->screening;
+	vector box = exp->box;
+
+	for (i = from; i < to; ++i)
+	{
+		/* the pulls of charge and of mass on object (i); its own charge and mass, and K and G, are applied once
+		 * they are summed, rather than to every pair */
+		qx = qy = D3(qz =) mx = my = D3(mz =) (real)0;
+
+		for (j = 0; j < n; ++j)
+		{
+			if (j == i)
+			/* do not calculate force on an object from itself */
+				continue;
+
+			/* The radius vector is a line connecting object (i) to object
+			 * (j), with the direction from object (i) towards (j). */
+			rx = P->x[j] - P->x[i];
+			ry = P->y[j] - P->y[i];
+			D3(rz = P->z[j] - P->z[i];)
+
+			if (box.x != 0)
+			/* towards the nearest image of object (j), in a periodic box */
+			{
+				rx -= box.x * floorr(rx / box.x + (real)0.5);
+				ry -= box.y * floorr(ry / box.y + (real)0.5);
+				D3(rz -= box.z * floorr(rz / box.z + (real)0.5);)
+			}
+
+			/* (w) is 1 / (r^2 + e^2)^(3/2), which is finite even where objects meet, from one root and one
+			 * quotient; both forces of the pair are then (w) times the radius, times the charge or mass */
+			rsquared = rx * rx + ry * ry D3(+ rz * rz) + e2;
+			s = sqrtr(rsquared);
+			w = (real)1 / (rsquared * s);
+
+			/* Gravitational force is an attractive force, thus (+=). */
+			mx += P->mass[j] * w * rx, my += P->mass[j] * w * ry D3(, mz += P->mass[j] * w * rz);
+
+			if (l != 0)
+			/* screened, by exp(-r / l) (1 + r / l) for the electric force */
+				w *= expr(-s / l) * (1 + s / l);
+
+			/* Electrostatic force is a repulsive force (on like-charges), thus (-=). */
+			qx -= P->charge[j] * w * rx, qy -= P->charge[j] * w * ry D3(, qz -= P->charge[j] * w * rz);
+		}
+
+		P->fex[i] = qx * K * P->charge[i], P->fey[i] = qy * K * P->charge[i] D3(, P->fez[i] = qz * K * P->charge[i]);
+		P->fgx[i] = mx * G * P->mass[i], P->fgy[i] = my * G * P->mass[i] D3(, P->fgz[i] = mz * G * P->mass[i]);
+	}
+}
+
+/* row: Return the first object (i) whose pairs (i, j > i) come after (share) of all pairs of (n) objects. */
+static int row(int n, double share)
+{
+	/* object (i) is preceded by i * (2n - i - 1) / 2 pairs */
+	double b = 2 * (double)n - 1;
+	int i;
+
+	if (share >= 1)
+		return n;
+
+	i = (int)ceil((b - sqrt(b * b - 4 * share * n * (n - 1))) / 2);
+
+	return i < 0 ? 0 : i > n ? n : i;
+}
+
+/* pairs: Sum the pulls of the pairs of the rows given to (worker) into its pull structure. */
+static void pairs(struct exp *exp, int worker, int nworkers)
+{
+	struct particles *P = &exp->particles;
+	struct pull *pull = &exp->pool.pull[worker];
+	int i, j, n = exp->nobjects, from = row(n, (double)worker / nworkers), to = row(n, (double)(worker + 1) / nworkers);
+	real rx, ry, D3(rz,) rsquared, w, qx, qy, D3(qz,) mx, my, D3(mz,) e2 = exp->softening * exp->softening;
+
+	for (i = 0; i < n; ++i)
+		pull->qx[i] = pull->qy[i] = D3(pull->qz[i] =) pull->mx[i] = pull->my[i] = D3(pull->mz[i] =) (real)0;
+
+	for (i = from; i < to; ++i)
+	{
+		qx = qy = D3(qz =) mx = my = D3(mz =) (real)0;
+
+		for (j = i + 1; j < n; ++j)
+		{
+			/* The radius vector is from object (i) towards object (j). */
+			rx = P->x[j] - P->x[i];
+			ry = P->y[j] - P->y[i];
+			D3(rz = P->z[j] - P->z[i];)
+			rsquared = rx * rx + ry * ry D3(+ rz * rz) + e2;
+			w = (real)1 / (rsquared * sqrtr(rsquared));
+
+			qx += P->charge[j] * w * rx, qy += P->charge[j] * w * ry D3(, qz += P->charge[j] * w * rz);
+			mx += P->mass[j] * w * rx, my += P->mass[j] * w * ry D3(, mz += P->mass[j] * w * rz);
+
+			/* and object (j) is pulled the opposite way, by object (i) */
+			pull->qx[j] -= P->charge[i] * w * rx, pull->qy[j] -= P->charge[i] * w * ry;
+			pull->mx[j] -= P->mass[i] * w * rx, pull->my[j] -= P->mass[i] * w * ry;
+			D3(pull->qz[j] -= P->charge[i] * w * rz, pull->mz[j] -= P->mass[i] * w * rz;)
+		}
+
+		pull->qx[i] += qx, pull->qy[i] += qy D3(, pull->qz[i] += qz);
+		pull->mx[i] += mx, pull->my[i] += my D3(, pull->mz[i] += mz);
+	}
+}
+
+/* reduce: Add the pull structures of every worker together, in order, into the forces of each object. */
+static void reduce(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	struct pull *pull = exp->pool.pull;
+	int i, k, nworkers = exp->pool.threads == NULL ? 1 : exp->pool.nthreads;
+	real qx, qy, D3(qz,) mx, my D3(, mz);
+
+	for (i = from; i < to; ++i)
+	{
+		qx = qy = D3(qz =) mx = my = D3(mz =) (real)0;
+
+		for (k = 0; k < nworkers; ++k)
+		{
+			qx += pull[k].qx[i], qy += pull[k].qy[i], mx += pull[k].mx[i], my += pull[k].my[i];
+			D3(qz += pull[k].qz[i], mz += pull[k].mz[i];)
+		}
+
+		/* as in (direct), electrostatic force repels like-charges and gravitational force attracts */
+		P->fex[i] = qx * -K * P->charge[i], P->fey[i] = qy * -K * P->charge[i] D3(, P->fez[i] = qz * -K * P->charge[i]);
+		P->fgx[i] = mx * G * P->mass[i], P->fgy[i] = my * G * P->mass[i] D3(, P->fgz[i] = mz * G * P->mass[i]);
+	}
+}
+
+int symmetric(struct exp *exp)
+{
+	struct pool *pool = &exp->pool;
+	int k, nworkers = pool->threads == NULL ? 1 : pool->nthreads;
+	real *arr;
+
+	if (pool->pull == NULL)
+	{
+		if ((pool->pull = calloc(nworkers, sizeof(struct pull))) == NULL
+		 || (arr = malloc(2 * DIM * nworkers * exp->nobjects * sizeof(real))) == NULL)
+		{
+			warn(WL_crash, "symmetric", "(malloc|calloc) returned NULL when attempting allocation of pull sums.\n");
+			free(pool->pull);
+			pool->pull = NULL;
+
+			return 0;
+		}
+
+		/* (qx) of the first pull structure owns the memory of all of them */
+		for (k = 0; k < nworkers; ++k)
+		{
+			pool->pull[k].qx = arr, arr += exp->nobjects;
+			pool->pull[k].qy = arr, arr += exp->nobjects;
+			D3(pool->pull[k].qz = arr, arr += exp->nobjects;)
+			pool->pull[k].mx = arr, arr += exp->nobjects;
+			pool->pull[k].my = arr, arr += exp->nobjects;
+			D3(pool->pull[k].mz = arr, arr += exp->nobjects;)
+		}
+	}
+
+	everyworker(exp, pairs);
+	parallel(exp, reduce);
+
+	return 1;
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int forces(struct exp *exp)
+{
+	struct tally *T = &exp->stats.compiler;
+	double t = seconds();
+	int r = 0;
+
+	switch (exp->routine)
+	{
+	case RT_direct:
+		parallel(exp, simd() && exp->screening == 0 ? directsimd : direct), r = 1;
+
+		break;
+
+	case RT_cutoff:
+		if ((r = mklists(exp)))
+			parallel(exp, cutoffcells);
+
+		break;
+
+	case RT_barneshut:
+		if ((r = mktree(exp)))
+			parallel(exp, barneshut);
+
+		break;
+
+	case RT_symmetric:
+		r = symmetric(exp);
+
+		break;
+
+	case RT_fmm:
+		r = fastmultipole(exp);
+
+		break;
+
+	case RT_ewald:
+		r = ewald(exp);
+
+		break;
+
+	case RT_pm:
+		r = pm(exp);
+
+		break;
+
+	default:
+		warn(WL_crash, "forces", "Unknown routine %i.\n", exp->routine);
+
+		return 0;
+	}
+
+	T->forces += seconds() - t, ++T->nforces;
+
+	return r;
+}
+
+/* usage: Warn, as (name), of the CPU time used by the calling thread for each of (frames) frames, and of the
+ * number of times it slept waiting for another thread, (sleeps).
+ */
+static void usage(const char *name, int frames, int sleeps)
+{
+	struct timespec ts;
+
+	if (frames == 0 || clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return;
+
+	warn(WL_verbose, name, "Used %e seconds of CPU time per frame over %i frames, and slept %i times.\n",
+	    ((long double)ts.tv_sec + ts.tv_nsec * 1e-9L) / frames, frames, sleeps);
+}
+
+/* relerr: Return the relative error of (a) against the reference (b); in long double, so that the squares of
+ * small forces do not underflow with the other real types. */
+static long double relerr(vector a, vector b)
+{
+	long double dx = (long double)a.x - b.x, dy = (long double)a.y - b.y D3(, dz = (long double)a.z - b.z);
+	long double norm = sqrtl((long double)b.x * b.x + (long double)b.y * b.y D3(+ (long double)b.z * b.z));
+
+	if (norm == 0)
+		return sqrtl((long double)a.x * a.x + (long double)a.y * a.y D3(+ (long double)a.z * a.z));
+
+	return sqrtl(dx * dx + dy * dy D3(+ dz * dz)) / norm;
+}
+
+/* compare: Sum the squares of the relative errors of the forces (f), as (fex, fey, fgx, fgy) of (n) objects, against
+ * the forces (ref) into (esum), and their largest into (emax); electric first, then gravitational.
+ */
+static void compare(const real *f, const real *ref, int n, long double *esum, long double *emax)
+{
+	long double e;
+	int i;
+
+	esum[0] = esum[1] = emax[0] = emax[1] = 0;
+
+	for (i = 0; i < n; ++i)
+	{
+		e = relerr(V_make(f[i], f[n + i], f[2 * n + i]), V_make(ref[i], ref[n + i], ref[2 * n + i]));
+		esum[0] += e * e;
+		emax[0] = e > emax[0] ? e : emax[0];
+
+		e = relerr(V_make(f[DIM * n + i], f[(DIM + 1) * n + i], f[(DIM + 2) * n + i]),
+		    V_make(ref[DIM * n + i], ref[(DIM + 1) * n + i], ref[(DIM + 2) * n + i]));
+		esum[1] += e * e;
+		emax[1] = e > emax[1] ? e : emax[1];
+	}
+}
+
+/* copyforces: Copy the forces of the (n) objects of the particles (P) into (f), as (fex, fey, fgx, fgy); each
+ * followed by its z-component, (fez) or (fgz), in three dimensions. */
+static void copyforces(real *f, const struct particles *P, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i)
+	{
+		f[i] = P->fex[i], f[n + i] = P->fey[i], f[DIM * n + i] = P->fgx[i], f[(DIM + 1) * n + i] = P->fgy[i];
+		D3(f[2 * n + i] = P->fez[i], f[5 * n + i] = P->fgz[i];)
+	}
+}
+
+void accuracy(struct exp *exp)
+{
+	static const char *routines[] = { "direct", "barnes-hut", "symmetric", "fmm", "cutoff", "ewald", "pm" };
+	struct particles *P = &exp->particles;
+	real *f, *ref;
+	long double emax[2], esum[2];
+	double t0, t1, t2;
+	const char *isa = exp->routine == RT_direct && exp->screening == 0 ? simd() : NULL;
+	int periodic = exp->routine == RT_ewald || (exp->routine == RT_pm && exp->box.x != 0);
+	const char *against = periodic ? "ewald" : "direct";
+	real split = exp->ewald.split, cutoff = exp->cutoff;
+	int n = exp->nobjects, order = exp->order, r;
+
+	/* forces of the routine, then of the reference, each as (fex, fey, fgx, fgy) */
+	if ((f = malloc(4 * DIM * n * sizeof(real))) == NULL)
+	{
+		warn(WL_crash, "accuracy", "malloc returned NULL.\n");
+
+		return;
+	}
+
+	ref = f + 2 * DIM * n;
+	t0 = seconds();
+
+	if (!forces(exp))
+	{
+		free(f);
+
+		return;
+	}
+
+	t1 = seconds();
+	copyforces(f, P, n);
+
+	/* in a periodic box, direct sums over the nearest image of every object; and the routines over every image are
+	 * compared against the ewald routine with the finer split of EW_REFERENCE, and the pm routine against it at the
+	 * cutoff of the least time, as its lists are built again for it */
+	if (periodic)
+	{
+		if (exp->routine == RT_pm)
+			exp->cutoff = ewaldcutoff(exp), exp->lists.built = 0;
+
+		exp->ewald.split = (real)EW_REFERENCE;
+		r = ewald(exp);
+		exp->ewald.split = split;
+
+		if (exp->routine == RT_pm)
+		{
+			exp->cutoff = cutoff, exp->lists.built = 0;
+			r = r && (cutoff == 0 || mklists(exp));
+		}
+
+		if (!r)
+		{
+			free(f);
+
+			return;
+		}
+	} else
+		parallel(exp, direct);
+
+	t2 = seconds();
+	copyforces(ref, P, n);
+	compare(f, ref, n, esum, emax);
+
+	printf("accuracy of %s%s%s%s against %s%s, %d objects:\n", routines[exp->routine],
+	    isa != NULL ? " (" : "", isa != NULL ? isa : "", isa != NULL ? ")" : "",
+	    against, exp->routine == RT_ewald ? " with a finer split" : periodic ? " with a fine split"
+	    : exp->box.x != 0 ? " over the nearest images" : "", n);
+
+	if (exp->routine == RT_barneshut)
+		printf("\t" "theta: %Le\n", (long double)exp->theta);
+
+	if (exp->routine == RT_fmm)
+		printf("\t" "order: %d\n", exp->order);
+
+	if (exp->routine == RT_pm)
+		printf("\t" "mesh: %d cells along each side, %Le wide\n", exp->pm.cells, (long double)exp->pm.h.x);
+
+	if (exp->routine == RT_cutoff || exp->routine == RT_ewald || (exp->routine == RT_pm && exp->cutoff != 0))
+		printf("\t" "cutoff: %Le, with %Le objects in each list on average\n", (long double)exp->cutoff,
+		    (long double)exp->lists.start[n] / n);
+
+	if (exp->routine == RT_ewald)
+		printf("\t" "split: %Le, reference %Le\n", (long double)split, (long double)EW_REFERENCE);
+
+	if (exp->box.x != 0)
+		printf("\t" "box: %Le by %Le" D3(" by %Le") "\n", (long double)exp->box.x, (long double)exp->box.y
+		    D3(, (long double)exp->box.z));
+
+	if (exp->screening != 0)
+		printf("\t" "screening: %Le\n", (long double)exp->screening);
+
+	printf("\t" "felec: rms %Le, max %Le\n"
+	       "\t" "fgrav: rms %Le, max %Le\n"
+	       "\t" "time: %e s, %s %e s\n"
+	       "\t" "rate: %e pairs/s, %s %e pairs/s\n",
+	    sqrtl(esum[0] / n), emax[0],
+	    sqrtl(esum[1] / n), emax[1],
+	    t1 - t0, against, t2 - t1,
+	    (double)n * (n - 1) / (t1 - t0), against, (double)n * (n - 1) / (t2 - t1));
+
+	if (exp->routine == RT_fmm)
+	/* the error and time of every order */
+	{
+		printf("\t" "%5s %12s %12s %12s %12s %12s\n", "order", "felec rms", "felec max", "fgrav rms", "fgrav max", "time (s)");
+
+		for (exp->order = 0; exp->order <= FMM_MAXORDER; ++exp->order)
+		{
+			t0 = seconds();
+
+			if (!forces(exp))
+				break;
+
+			t1 = seconds();
+			copyforces(f, P, n);
+			compare(f, ref, n, esum, emax);
+
+			printf("\t" "%5d %12.3Le %12.3Le %12.3Le %12.3Le %12.3e\n", exp->order,
+			    sqrtl(esum[0] / n), emax[0], sqrtl(esum[1] / n), emax[1], t1 - t0);
+		}
+
+		exp->order = order;
+	}
+
+	free(f);
+}
+
+/* record: Record object (i), with the acceleration (acc), in the frame being compiled. */
+static void record(struct exp *exp, int i, vector acc)
+{
+	struct particles *P = &exp->particles;
+	vector *s = &exp->pool.frame->system[i * exp->nfields];
+
+	if (exp->fields & F_felec)  *s++ = V_make(P->fex[i], P->fey[i], P->fez[i]);
+	if (exp->fields & F_fgrav)  *s++ = V_make(P->fgx[i], P->fgy[i], P->fgz[i]);
+	if (exp->fields & F_acc)    *s++ = acc;
+	if (exp->fields & F_vel)    *s++ = V_make(P->vx[i], P->vy[i], P->vz[i]);
+	if (exp->fields & F_loc)    *s++ = V_make(P->x[i], P->y[i], P->z[i]);
+}
+
+/* kinematics: Step the velocities of objects by (kick), and then their locations by (drift), as set in the pool. */
+static void kinematics(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	vector acc;
+	int i;
+
+	for (i = from; i < to; ++i)
+	{
+		acc = V_make((P->fex[i] + P->fgx[i]) / P->mass[i], (P->fey[i] + P->fgy[i]) / P->mass[i],
+		    (P->fez[i] + P->fgz[i]) / P->mass[i]);
+
+		if (exp->pool.frame != NULL)
+			record(exp, i, acc);
+
+		P->vx[i] += acc.x * exp->pool.kick;
+		P->vy[i] += acc.y * exp->pool.kick;
+		D3(P->vz[i] += acc.z * exp->pool.kick;)
+		P->x[i] += P->vx[i] * exp->pool.drift;
+		P->y[i] += P->vy[i] * exp->pool.drift;
+		D3(P->z[i] += P->vz[i] * exp->pool.drift;)
+	}
+}
+
+/* runge: Take stage (stage) of a step of the rk4 integrator; the derivatives of this stage are the velocities and
+ * accelerations of the objects as they are, which are added to the sums with a weight of 1, 2, 2 and then 1, and
+ * the objects are moved to the beginning of the step plus a half, a half, and then a whole step along them. The
+ * last stage moves the objects to the beginning of the step plus a whole step along the weighted sums, over 6.
+ */
+static void runge(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	vector acc;
+	real step, weight;
+	int i, stage = exp->pool.stage;
+
+	step = stage == 2 ? exp->pool.h : exp->pool.h / 2;
+	weight = stage == 0 || stage == 3 ? 1 : 2;
+
+	for (i = from; i < to; ++i)
+	{
+		acc = V_make((P->fex[i] + P->fgx[i]) / P->mass[i], (P->fey[i] + P->fgy[i]) / P->mass[i],
+		    (P->fez[i] + P->fgz[i]) / P->mass[i]);
+
+		if (stage == 0)
+		{
+			if (exp->pool.frame != NULL)
+				record(exp, i, acc);
+
+			P->x0[i] = P->x[i], P->y0[i] = P->y[i] D3(, P->z0[i] = P->z[i]);
+			P->vx0[i] = P->vx[i], P->vy0[i] = P->vy[i] D3(, P->vz0[i] = P->vz[i]);
+			P->dx[i] = P->dy[i] = D3(P->dz[i] =) P->dvx[i] = P->dvy[i] = D3(P->dvz[i] =) (real)0;
+		}
+
+		P->dx[i] += weight * P->vx[i], P->dy[i] += weight * P->vy[i] D3(, P->dz[i] += weight * P->vz[i]);
+		P->dvx[i] += weight * acc.x, P->dvy[i] += weight * acc.y D3(, P->dvz[i] += weight * acc.z);
+
+		if (stage == 3)
+		{
+			P->x[i] = P->x0[i] + P->dx[i] * exp->pool.h / 6, P->y[i] = P->y0[i] + P->dy[i] * exp->pool.h / 6;
+			P->vx[i] = P->vx0[i] + P->dvx[i] * exp->pool.h / 6, P->vy[i] = P->vy0[i] + P->dvy[i] * exp->pool.h / 6;
+			D3(P->z[i] = P->z0[i] + P->dz[i] * exp->pool.h / 6, P->vz[i] = P->vz0[i] + P->dvz[i] * exp->pool.h / 6;)
+
+			continue;
+		}
+
+		P->x[i] = P->x0[i] + P->vx[i] * step, P->y[i] = P->y0[i] + P->vy[i] * step;
+		P->vx[i] = P->vx0[i] + acc.x * step, P->vy[i] = P->vy0[i] + acc.y * step;
+		D3(P->z[i] = P->z0[i] + P->vz[i] * step, P->vz[i] = P->vz0[i] + acc.z * step;)
+	}
+}
+
+/* EN_hash: Return the list of the cell in column (_cx), row (_cy) and layer (_cz) of the grid of encounters, of (_n)
+ * lists; (_cz) is not evaluated in two dimensions. */
+#define EN_hash(_cx, _cy, _cz, _n)  (int)(((unsigned long long)(_cx) * 73856093u ^ (unsigned long long)(_cy) * 19349663u \
+                                          D3(^ (unsigned long long)(_cz) * 83492791u)) & (unsigned long long)((_n) - 1))
+
+/* strength: Return the strength (mu) of the pull of objects (i) and (j) towards each other, as the acceleration of
+ * one relative to the other is -mu r / r^3 for the radius vector (r) between them; or 0 if either has no mass.
+ */
+static real strength(struct particles *P, int i, int j)
+{
+	if (P->mass[i] == 0 || P->mass[j] == 0)
+		return 0;
+
+	return (P->mass[i] + P->mass[j]) * (G - K * P->charge[i] * P->charge[j] / (P->mass[i] * P->mass[j]));
+}
+
+/* mutual: Return the force on object (i) from object (j) alone, as the routines calculate it. */
+static vector mutual(struct exp *exp, int i, int j)
+{
+	struct particles *P = &exp->particles;
+	real rx = P->x[j] - P->x[i], ry = P->y[j] - P->y[i], D3(rz = P->z[j] - P->z[i],) rsquared, w;
+
+	rsquared = rx * rx + ry * ry D3(+ rz * rz) + exp->softening * exp->softening;
+	w = (G * P->mass[i] * P->mass[j] - K * P->charge[i] * P->charge[j]) / (rsquared * sqrtr(rsquared));
+
+	return V_make(rx * w, ry * w, rz * w);
+}
+
+/* nearest: Find the nearest object to every object within (encounter) that it could be paired with. */
+static void nearest(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	real rx, ry, D3(rz,) rsquared, best, width = exp->encounter;
+	long long cx, cy, D3(cz, z,) x, y;
+	int i, j;
+
+	for (i = from; i < to; ++i)
+	{
+		cx = (long long)floorr(P->x[i] / width), cy = (long long)floorr(P->y[i] / width);
+		D3(cz = (long long)floorr(P->z[i] / width);)
+		best = width * width;
+		P->nearest[i] = -1;
+
+		/* lists shared by more than one cell only give objects too far away, which are passed over */
+		D3(for (z = cz - 1; z <= cz + 1; ++z))
+		for (y = cy - 1; y <= cy + 1; ++y)
+			for (x = cx - 1; x <= cx + 1; ++x)
+				for (j = P->head[EN_hash(x, y, z, P->nhead)]; j != -1; j = P->chain[j])
+				{
+					rx = P->x[j] - P->x[i], ry = P->y[j] - P->y[i];
+					D3(rz = P->z[j] - P->z[i];)
+					rsquared = rx * rx + ry * ry D3(+ rz * rz);
+
+					if (j == i || rsquared >= best || rsquared == 0 || strength(P, i, j) <= 0)
+						continue;
+
+					best = rsquared;
+					P->nearest[i] = j;
+				}
+	}
+}
+
+/* match: Pair every object with the nearest object found for it, if that object's nearest is it in turn. */
+static void match(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	int i, j;
+
+	for (i = from; i < to; ++i)
+		P->partner[i] = (j = P->nearest[i]) != -1 && P->nearest[j] == i ? j : -1;
+}
+
+/* perturb: Step the velocities of objects by (kick), as set in the pool, from the forces on them less the force
+ * of their partner; the motion of a pair about itself is stepped by (orbit).
+ */
+static void perturb(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	vector acc, f;
+	int i;
+
+	for (i = from; i < to; ++i)
+	{
+		acc = V_make((P->fex[i] + P->fgx[i]) / P->mass[i], (P->fey[i] + P->fgy[i]) / P->mass[i],
+		    (P->fez[i] + P->fgz[i]) / P->mass[i]);
+
+		if (exp->pool.frame != NULL)
+			record(exp, i, acc);
+
+		if (P->partner[i] != -1)
+			f = mutual(exp, i, P->partner[i]), acc = V_sub(acc, V_div(f, P->mass[i]));
+
+		P->vx[i] += acc.x * exp->pool.kick;
+		P->vy[i] += acc.y * exp->pool.kick;
+		D3(P->vz[i] += acc.z * exp->pool.kick;)
+	}
+}
+
+/* stumpff: Set (c) and (s) to Stumpff's functions C(z) and S(z). */
+static void stumpff(long double z, long double *c, long double *s)
+{
+	long double q;
+
+	if (fabsl(z) < 1e-2L)
+	/* by their series, where the closed forms lose their digits */
+	{
+		*c = 1 / 2.0L - z * (1 / 24.0L - z * (1 / 720.0L - z * (1 / 40320.0L - z / 3628800.0L)));
+		*s = 1 / 6.0L - z * (1 / 120.0L - z * (1 / 5040.0L - z * (1 / 362880.0L - z / 39916800.0L)));
+	} else
+	if (z > 0)
+	{
+		q = sqrtl(z);
+		*c = (1 - cosl(q)) / z;
+		*s = (q - sinl(q)) / (z * q);
+	} else {
+		q = sqrtl(-z);
+		*c = (coshl(q) - 1) / -z;
+		*s = (sinhl(q) - q) / (-z * q);
+	}
+}
+
+/* Kepler's equation in the universal anomaly (chi), for a radius (r0), radial velocity (vr) and reciprocal of the
+ * semi-major axis (alpha) at the beginning of a step of (t), is
+ *     sqrt(mu) t = r0 vr / sqrt(mu) chi^2 C + (1 - alpha r0) chi^3 S + r0 chi,
+ * with C and S of z = alpha chi^2, whatever the orbit; its derivative by (chi) is the radius at the end. */
+
+/* kepler: Step the radius vector (rx, ry (, rz)) and velocity (vx, vy (, vz)) of one object relative to another,
+ * which pull on each other with a strength (mu) greater than 0, by (t), as if they were alone; the orbit lies in the
+ * plane of the two. Returns 0 if Kepler's equation could not be solved, and 1 on success.
+ */
+static int kepler(long double *rx, long double *ry, D3(long double *rz,) long double *vx, long double *vy,
+    D3(long double *vz,) long double mu, long double t)
+{
+	long double r0 = hypotl(*rx, *ry), smu = sqrtl(mu), vr, alpha, chi, z, c, s, f, df, ddf, delta, r, g, fdot, gdot;
+	long double x, y D3(, w);  /* the radius at the end; (w) is its z-component */
+	int k;
+
+	D3(r0 = hypotl(r0, *rz);)
+	vr = (*rx * *vx + *ry * *vy D3(+ *rz * *vz)) / r0;
+	alpha = 2 / r0 - (*vx * *vx + *vy * *vy D3(+ *vz * *vz)) / mu;
+
+	/* a bound orbit is the same after every period, so only what remains of the last one need be solved for */
+	if (alpha > 0)
+		t = fmodl(t, 2 * 3.14159265358979323846264338327950L / (smu * alpha * sqrtl(alpha)));
+
+	chi = alpha > 0 ? smu * alpha * t : smu * t / r0;
+
+	/* by the method of Laguerre, as Conway gives it, which converges from nearly any guess */
+	for (k = 0; k < 64; ++k)
+	{
+		z = alpha * chi * chi;
+		stumpff(z, &c, &s);
+
+		f = r0 * vr / smu * chi * chi * c + (1 - alpha * r0) * chi * chi * chi * s + r0 * chi - smu * t;
+		df = r0 * vr / smu * chi * (1 - z * s) + (1 - alpha * r0) * chi * chi * c + r0;
+		ddf = r0 * vr / smu * (1 - z * c) + (1 - alpha * r0) * chi * (1 - z * s);
+
+		delta = sqrtl(fabsl(16 * df * df - 20 * f * ddf));
+		delta = 5 * f / (df + (df < 0 ? -delta : delta));
+		chi -= delta;
+
+		if (fabsl(delta) <= 1e-15L * fabsl(chi) || delta == 0)
+			break;
+	}
+
+	if (k == 64 || !isfinite(chi))
+		return 0;
+
+	/* the Lagrange coefficients, from which the radius and velocity at the end follow */
+	z = alpha * chi * chi;
+	stumpff(z, &c, &s);
+
+	f = 1 - chi * chi / r0 * c;
+	g = t - chi * chi * chi * s / smu;
+	x = f * *rx + g * *vx, y = f * *ry + g * *vy;
+	r = hypotl(x, y);
+	D3(w = f * *rz + g * *vz, r = hypotl(r, w);)
+	fdot = smu / (r * r0) * chi * (z * s - 1);
+	gdot = 1 - chi * chi / r * c;
+
+	*vx = fdot * *rx + gdot * *vx, *vy = fdot * *ry + gdot * *vy;
+	*rx = x, *ry = y;
+	D3(*vz = fdot * *rz + gdot * *vz, *rz = w;)
+
+	return 1;
+}
+
+/* orbit: Step the locations of objects by (h), as set in the pool; those paired in an encounter move about their
+ * center of mass as if they were alone, while it moves as any other object does.
+ */
+static void orbit(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	long double rx, ry, D3(rz,) vx, vy, D3(vz,) m, a, b, cx, cy, D3(cz,) cvx, cvy D3(, cvz);
+	real h = exp->pool.h;
+	int i, j;
+
+	for (i = from; i < to; ++i)
+	{
+		/* a pair is stepped by its first object, whichever worker has the second */
+		if ((j = P->partner[i]) > i)
+		{
+			m = P->mass[i] + P->mass[j], a = P->mass[i] / m, b = P->mass[j] / m;
+			rx = P->x[i] - P->x[j], ry = P->y[i] - P->y[j] D3(, rz = P->z[i] - P->z[j]);
+			vx = P->vx[i] - P->vx[j], vy = P->vy[i] - P->vy[j] D3(, vz = P->vz[i] - P->vz[j]);
+
+			if (kepler(&rx, &ry, D3(&rz,) &vx, &vy, D3(&vz,) strength(P, i, j), h))
+			{
+				cvx = a * P->vx[i] + b * P->vx[j], cvy = a * P->vy[i] + b * P->vy[j];
+				cx = a * P->x[i] + b * P->x[j] + cvx * h, cy = a * P->y[i] + b * P->y[j] + cvy * h;
+
+				P->x[i] = cx + b * rx, P->y[i] = cy + b * ry;
+				P->x[j] = cx - a * rx, P->y[j] = cy - a * ry;
+				P->vx[i] = cvx + b * vx, P->vy[i] = cvy + b * vy;
+				P->vx[j] = cvx - a * vx, P->vy[j] = cvy - a * vy;
+
+#if DIM == 3
+				cvz = a * P->vz[i] + b * P->vz[j];
+				cz = a * P->z[i] + b * P->z[j] + cvz * h;
+				P->z[i] = cz + b * rz, P->z[j] = cz - a * rz;
+				P->vz[i] = cvz + b * vz, P->vz[j] = cvz - a * vz;
+#endif
+
+				continue;
+			}
+
+			/* as any other pair of objects, if the pair could not be stepped */
+			P->x[j] += P->vx[j] * h, P->y[j] += P->vy[j] * h D3(, P->z[j] += P->vz[j] * h);
+		} else
+		if (j != -1)
+			continue;
+
+		P->x[i] += P->vx[i] * h;
+		P->y[i] += P->vy[i] * h;
+		D3(P->z[i] += P->vz[i] * h;)
+	}
+}
+
+/* encounters: Step the objects of (exp) by (h), pairing those in encounters as (nearest) and (match) do, with
+ * half a step of (perturb) on either side of a whole step of (orbit). The forces must be those of the current
+ * locations. Returns 0 on failure, and 1 on success.
+ */
+static int encounters(struct exp *exp, real h)
+{
+	struct particles *P = &exp->particles;
+	int i, k;
+
+	for (k = 0; k < P->nhead; ++k)
+		P->head[k] = -1;
+
+	for (i = 0; i < exp->nobjects; ++i)
+	{
+		k = EN_hash((long long)floorr(P->x[i] / exp->encounter), (long long)floorr(P->y[i] / exp->encounter),
+		    (long long)floorr(P->z[i] / exp->encounter), P->nhead);
+		P->chain[i] = P->head[k];
+		P->head[k] = i;
+	}
+
+	parallel(exp, nearest);
+	parallel(exp, match);
+
+	exp->pool.h = h;
+	exp->pool.kick = h / 2;
+	parallel(exp, perturb);
+	exp->pool.frame = NULL;
+	parallel(exp, orbit);
+
+	if (!forces(exp))
+		return 0;
+
+	parallel(exp, perturb);
+
+	return P->fresh = 1;
+}
+
+/* Yoshida's weights, 1 / (2 - 2^(1/3)) and -2^(1/3) / (2 - 2^(1/3)) */
+#define IN_W1  ((real)1.35120719195965763404768780897L)
+#define IN_W0  ((real)-1.70241438391931526809537561794L)
+
+/* stages of a step of each integrator but rk4; the kick and drift of each, as fractions of (delta), with forces
+ * calculated between them. A step ending in a kick leaves the forces of the new locations behind it. */
+static const struct
+{
+	int nstages;
+	real stage[4][2];
+} integrators[] = {
+	{ 1, { { 1, 1 } } },
+	{ 2, { { (real)0.5, 1 }, { (real)0.5, 0 } } },
+	{ 4, { { IN_W1 / 2, IN_W1 }, { (IN_W1 + IN_W0) / 2, IN_W0 }, { (IN_W0 + IN_W1) / 2, IN_W1 }, { IN_W1 / 2, 0 } } }
+};
+
+/* step: Step the objects of (exp) by (h) with its integrator; the forces must be those of the current locations.
+ * Returns 0 on failure, and 1 on success.
+ */
+static int step(struct exp *exp, real h)
+{
+	struct particles *P = &exp->particles;
+	int k, nstages;
+
+	P->fresh = 0;
+	exp->pool.h = h;
+
+	if (exp->encounter > 0)
+		return encounters(exp, h);
+
+	if (exp->integrator == IN_rk4)
+	{
+		for (exp->pool.stage = 0; exp->pool.stage < 4; ++exp->pool.stage)
+		{
+			if (exp->pool.stage > 0 && !forces(exp))
+				return 0;
+
+			parallel(exp, runge);
+			exp->pool.frame = NULL;
+		}
+
+		return P->fresh = forces(exp);
+	}
+
+	nstages = integrators[exp->integrator].nstages;
+
+	for (k = 0; k < nstages; ++k)
+	{
+		if (k > 0 && !forces(exp))
+			return 0;
+
+		exp->pool.kick = integrators[exp->integrator].stage[k][0] * h;
+		exp->pool.drift = integrators[exp->integrator].stage[k][1] * h;
+		parallel(exp, kinematics);
+		exp->pool.frame = NULL;
+	}
+
+	P->fresh = integrators[exp->integrator].stage[nstages - 1][1] == 0;
+
+	return 1;
+}
+
+/* save: Copy the locations, velocities and forces of objects into the saved state of adaptive time steps.
+ * restore: Copy them back from the saved state.
+ */
+static void save(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	real *s = P->save;
+	int i, n = exp->nobjects;
+
+	for (i = from; i < to; ++i)
+	{
+		s[i] = P->x[i], s[n + i] = P->y[i], s[DIM * n + i] = P->vx[i], s[(DIM + 1) * n + i] = P->vy[i];
+		s[2 * DIM * n + i] = P->fex[i], s[(2 * DIM + 1) * n + i] = P->fey[i];
+		s[3 * DIM * n + i] = P->fgx[i], s[(3 * DIM + 1) * n + i] = P->fgy[i];
+		D3(s[2 * n + i] = P->z[i], s[5 * n + i] = P->vz[i], s[8 * n + i] = P->fez[i], s[11 * n + i] = P->fgz[i];)
+	}
+}
+
+static void restore(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	real *s = P->save;
+	int i, n = exp->nobjects;
+
+	for (i = from; i < to; ++i)
+	{
+		P->x[i] = s[i], P->y[i] = s[n + i], P->vx[i] = s[DIM * n + i], P->vy[i] = s[(DIM + 1) * n + i];
+		P->fex[i] = s[2 * DIM * n + i], P->fey[i] = s[(2 * DIM + 1) * n + i];
+		P->fgx[i] = s[3 * DIM * n + i], P->fgy[i] = s[(3 * DIM + 1) * n + i];
+		D3(P->z[i] = s[2 * n + i], P->vz[i] = s[5 * n + i], P->fez[i] = s[8 * n + i], P->fgz[i] = s[11 * n + i];)
+	}
+}
+
+/* The error of a step of length h is taken as the difference between the change in velocity of a first-order step,
+ * h a, and that of a second-order step, h (a + a') / 2, relative to the velocity and the change in it; that is,
+ * h |a' - a| / 2 (|v| + h |a|), with the acceleration a at its beginning and a' at its end. */
+
+/* adaptive: Step the objects of (exp) by (delta), in steps whose error is within (tolerance); a step whose error
+ * is not is taken again from its beginning, shorter, and the next step after one that is may be longer. The
+ * forces must be those of the current locations. Returns 0 on failure, and 1 on success.
+ */
+static int adaptive(struct exp *exp)
+{
+	struct particles *P = &exp->particles;
+	real *s = P->save, done = 0, h, hmin = exp->delta / (1 << TS_MAXLEVEL), e, emax, factor;
+	real ax, ay, D3(az,) bx, by, D3(bz,) v, a;
+	int i, last, n = exp->nobjects;
+
+	while (done < exp->delta)
+	{
+		h = P->h;
+		last = h >= exp->delta - done;
+
+		if (last)
+			h = exp->delta - done;
+
+		parallel(exp, save);
+
+		if (!step(exp, h) || (!P->fresh && !forces(exp)))
+			return 0;
+
+		P->fresh = 1;
+
+		for (i = 0, emax = 0; i < n; ++i)
+		{
+			/* the motion of a pair about itself is exact, whatever the step */
+			if (exp->encounter > 0 && P->partner[i] != -1)
+				continue;
+
+			ax = (s[2 * DIM * n + i] + s[3 * DIM * n + i]) / P->mass[i];
+			ay = (s[(2 * DIM + 1) * n + i] + s[(3 * DIM + 1) * n + i]) / P->mass[i];
+			bx = (P->fex[i] + P->fgx[i]) / P->mass[i], by = (P->fey[i] + P->fgy[i]) / P->mass[i];
+			D3(az = (s[8 * n + i] + s[11 * n + i]) / P->mass[i], bz = (P->fez[i] + P->fgz[i]) / P->mass[i];)
+			v = sqrtr(s[DIM * n + i] * s[DIM * n + i] + s[(DIM + 1) * n + i] * s[(DIM + 1) * n + i]
+			    D3(+ s[5 * n + i] * s[5 * n + i]));
+			a = sqrtr(ax * ax + ay * ay D3(+ az * az));
+			e = sqrtr((bx - ax) * (bx - ax) + (by - ay) * (by - ay) D3(+ (bz - az) * (bz - az)));
+
+			if (e == 0)
+				continue;
+
+			e = h * e / (2 * (v + h * a));
+			emax = e > emax ? e : emax;
+		}
+
+		/* the error is about proportional to the square of the step */
+		factor = emax == 0 ? 2 : (real)0.9 * sqrtr(exp->tolerance / emax);
+
+		if (emax > exp->tolerance && h > hmin)
+		/* take the step again from its beginning, shorter */
+		{
+			parallel(exp, restore);
+			P->h = h * (factor < (real)0.2 ? (real)0.2 : factor);
+			P->h = P->h < hmin ? hmin : P->h;
+
+			continue;
+		}
+
+		done = last ? exp->delta : done + h;
+		exp->pool.frame = NULL;
+
+		/* a step cut short to end at (delta) does not say how long the next may be */
+		if (!last || h >= P->h)
+			P->h = h * (factor > 2 ? 2 : factor);
+	}
+
+	return 1;
+}
+
+/* choose: Return the level for object (i) of block time steps; that of the longest step whose error is within
+ * (tolerance), taking the change in acceleration over the step as the change in it over time times the step.
+ */
+static int choose(struct exp *exp, int i)
+{
+	struct particles *P = &exp->particles;
+	real h = exp->delta, v, a, j;
+	int k;
+
+	v = sqrtr(P->vx[i] * P->vx[i] + P->vy[i] * P->vy[i] D3(+ P->vz[i] * P->vz[i]));
+	a = sqrtr(P->ax[i] * P->ax[i] + P->ay[i] * P->ay[i] D3(+ P->az[i] * P->az[i]));
+	j = sqrtr(P->jx[i] * P->jx[i] + P->jy[i] * P->jy[i] D3(+ P->jz[i] * P->jz[i]));
+
+	for (k = 0; k < TS_MAXLEVEL && h * h * j > 2 * exp->tolerance * (v + h * a); ++k)
+		h /= 2;
+
+	return k;
+}
+
+/* ticks of the steps of level (_k), over the steps of TS_MAXLEVEL */
+#define TS_ticks(_k)  (1 << (TS_MAXLEVEL - (_k)))
+
+/* opening: For the objects that begin a step at (tick), record them if a frame is being compiled, hold their
+ * acceleration, and step their velocities by half of their step.
+ * closing: For the (active) objects, which end a step, split between the workers, step their velocities by half of their step, and choose
+ * their next level; a longer step may only be taken once the objects of its level are at the beginning of one.
+ */
+static void opening(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	real h;
+	int i;
+
+	for (i = from; i < to; ++i)
+	{
+		if (exp->pool.tick % TS_ticks(P->level[i]) != 0)
+			continue;
+
+		P->ax[i] = (P->fex[i] + P->fgx[i]) / P->mass[i];
+		P->ay[i] = (P->fey[i] + P->fgy[i]) / P->mass[i];
+		D3(P->az[i] = (P->fez[i] + P->fgz[i]) / P->mass[i];)
+
+		if (exp->pool.frame != NULL)
+			record(exp, i, V_make(P->ax[i], P->ay[i], P->az[i]));
+
+		h = exp->delta / (1 << P->level[i]);
+		P->vx[i] += P->ax[i] * h / 2;
+		P->vy[i] += P->ay[i] * h / 2;
+		D3(P->vz[i] += P->az[i] * h / 2;)
+	}
+}
+
+static void closing(struct exp *exp, int worker, int nworkers)
+{
+	struct particles *P = &exp->particles;
+	real h, ax, ay D3(, az);
+	int i, k, level, to = (int)((long)P->nactive * (worker + 1) / nworkers);
+
+	for (k = (int)((long)P->nactive * worker / nworkers); k < to; ++k)
+	{
+		i = P->active[k];
+		h = exp->delta / (1 << P->level[i]);
+		ax = (P->fex[i] + P->fgx[i]) / P->mass[i];
+		ay = (P->fey[i] + P->fgy[i]) / P->mass[i];
+		D3(az = (P->fez[i] + P->fgz[i]) / P->mass[i];)
+
+		P->vx[i] += ax * h / 2;
+		P->vy[i] += ay * h / 2;
+		D3(P->vz[i] += az * h / 2;)
+		P->jx[i] = (ax - P->ax[i]) / h;
+		P->jy[i] = (ay - P->ay[i]) / h;
+		D3(P->jz[i] = (az - P->az[i]) / h;)
+		P->ax[i] = ax, P->ay[i] = ay D3(, P->az[i] = az);
+
+		level = choose(exp, i);
+
+		if (level < P->level[i])
+			level = exp->pool.tick % TS_ticks(P->level[i] - 1) == 0 ? P->level[i] - 1 : P->level[i];
+
+		P->level[i] = level;
+	}
+}
+
+/* subset: Calculate the forces on the (active) objects with the routine, split between the workers; only for
+ * routines that calculate the forces on each object apart from the others.
+ */
+static void subset(struct exp *exp, int worker, int nworkers)
+{
+	struct particles *P = &exp->particles;
+	void (*job)(struct exp *, int, int) = exp->routine == RT_barneshut ? barneshut : exp->routine == RT_cutoff ? cutoff
+	                                    : simd() && exp->screening == 0 ? directsimd : direct;
+	int k, to = (int)((long)P->nactive * (worker + 1) / nworkers);
+
+	for (k = (int)((long)P->nactive * worker / nworkers); k < to; ++k)
+		job(exp, P->active[k], P->active[k] + 1);
+}
+
+/* block: Step the objects of (exp) by (delta), each in steps of its own level, with velocity Verlet. Every object
+ * is moved on every step of the last level, and only the objects that end a step have their forces calculated,
+ * and their velocities stepped. The forces must be those of the current locations. Returns 0 on failure, and 1
+ * on success.
+ */
+static int block(struct exp *exp)
+{
+	struct particles *P = &exp->particles;
+	double t;
+	real h;
+	int i, n = exp->nobjects, last;
+
+	if (P->level[0] == -1)
+	/* the change in acceleration of every object over the shortest step, to choose the first levels */
+	{
+		h = exp->delta / (1 << TS_MAXLEVEL);
+
+		for (i = 0; i < n; ++i)
+		{
+			P->ax[i] = (P->fex[i] + P->fgx[i]) / P->mass[i], P->ay[i] = (P->fey[i] + P->fgy[i]) / P->mass[i];
+			P->jx[i] = P->x[i], P->jy[i] = P->y[i];
+			P->x[i] += (P->vx[i] + P->ax[i] * h / 2) * h, P->y[i] += (P->vy[i] + P->ay[i] * h / 2) * h;
+			D3(P->az[i] = (P->fez[i] + P->fgz[i]) / P->mass[i], P->jz[i] = P->z[i];)
+			D3(P->z[i] += (P->vz[i] + P->az[i] * h / 2) * h;)
+		}
+
+		if (!forces(exp))
+			return 0;
+
+		for (i = 0; i < n; ++i)
+		{
+			P->x[i] = P->jx[i], P->y[i] = P->jy[i] D3(, P->z[i] = P->jz[i]);
+			P->jx[i] = ((P->fex[i] + P->fgx[i]) / P->mass[i] - P->ax[i]) / h;
+			P->jy[i] = ((P->fey[i] + P->fgy[i]) / P->mass[i] - P->ay[i]) / h;
+			D3(P->jz[i] = ((P->fez[i] + P->fgz[i]) / P->mass[i] - P->az[i]) / h;)
+			P->level[i] = choose(exp, i);
+		}
+
+		if (!forces(exp))
+			return 0;
+	}
+
+	for (exp->pool.tick = 0; exp->pool.tick < TS_ticks(0); )
+	{
+		parallel(exp, opening);
+		exp->pool.frame = NULL;
+
+		/* every object is moved on the steps of the last level */
+		for (i = 0, last = 0; i < n; ++i)
+			last = P->level[i] > last ? P->level[i] : last;
+
+		exp->pool.kick = 0;
+		exp->pool.drift = exp->delta / (1 << last);
+		parallel(exp, kinematics);
+		exp->pool.tick += TS_ticks(last);
+
+		for (i = 0, P->nactive = 0; i < n; ++i)
+			if (exp->pool.tick % TS_ticks(P->level[i]) == 0)
+				P->active[P->nactive++] = i;
+
+		if (exp->routine == RT_direct || exp->routine == RT_barneshut || exp->routine == RT_cutoff)
+		/* timed as (forces) times itself */
+		{
+			t = seconds();
+
+			if ((exp->routine == RT_barneshut && !mktree(exp)) || (exp->routine == RT_cutoff && !mklists(exp)))
+				return 0;
+
+			everyworker(exp, subset);
+			exp->stats.compiler.forces += seconds() - t, ++exp->stats.compiler.nforces;
+		} else
+		if (!forces(exp))
+			return 0;
+
+		everyworker(exp, closing);
+	}
+
+	P->fresh = 1;
+
+	return 1;
+}
+
+/* wrap: Wrap the objects from (from) up to (to) that have left the periodic box back into it. */
+static void wrap(struct exp *exp, int from, int to)
+{
+	struct particles *P = &exp->particles;
+	int i;
+
+	for (i = from; i < to; ++i)
+	{
+		P->x[i] -= exp->box.x * floorr(P->x[i] / exp->box.x);
+		P->y[i] -= exp->box.y * floorr(P->y[i] / exp->box.y);
+		D3(P->z[i] -= exp->box.z * floorr(P->z[i] / exp->box.z);)
+	}
+}
+
+/* mkframe: Record the objects in (frame) as frame (n), then step them to frame (n + stride); steps past the limit
+ * are not taken. Returns 0 on failure, and the number of steps taken on success.
+ */
+static int mkframe(struct exp *exp, struct frame *frame, int n)
+{
+	int k;
+
+	frame->n = n;
+
+	for (k = 0; k < exp->stride && (k == 0 || n + k <= exp->limit); ++k)
+	{
+		/* objects that have left a periodic box are wrapped back into it, which does not change their forces */
+		if (exp->box.x != 0)
+			parallel(exp, wrap);
+
+		/* routine; every force must be calculated before any object is moved */
+		if (!exp->particles.fresh && !forces(exp))
+			return 0;
+
+		exp->pool.frame = k == 0 && exp->nfields != 0 ? frame : NULL;
+
+		switch (exp->timestep)
+		{
+		case TS_fixed:
+			if (!step(exp, exp->delta))
+				return 0;
+
+			break;
+
+		case TS_adaptive:
+			if (!adaptive(exp))
+				return 0;
+
+			break;
+
+		case TS_block:
+			if (!block(exp))
+				return 0;
+
+			break;
+		}
+	}
+
+	return k;
+}
+
+/* handed: Return the number of frames handed to the renderer by the compiler, of tally (C); each is of (stride)
+ * steps, but for the last, which may be cut short by the limit.
+ */
+static int handed(struct exp *exp, const struct tally *C)
+{
+	return (C->frames + exp->stride - 1) / exp->stride;
+}
+
+void *compiler(void *arg)
+{
+	struct exp *exp = (struct exp *)arg;
+	struct tally *T = &exp->stats.compiler;
+	double elapsed = 0, t, u, f;
+	int n, slot, steps;
+
+	warn(WL_verbose, "compiler", "Initialized.\n");
+
+	if (!mkpool(exp))
+	{
+		warn(WL_verbose, "compiler", "Got error in (mkpool); sending signals to stop.\n");
+		stopthreads(exp);
+	}
+
+	for (slot = 0, n = exp->begin; n <= exp->limit && readmutexint(&exp->run); slot = (slot + 1) % R_toofar, n += exp->stride)
 	{
-		pthread_mutex_lock(&compiler_mutex);
+		t = seconds();
+		pthread_mutex_lock(&exp->stepsahead.mutex);
+		T->lock += (u = seconds()) - t;
+
+		if (exp->stepsahead.value == R_toofar)
+		/* every slot is full; sleep until the renderer has handed back half of them */
+		{
+			warn(WL_verbose, "compiler", "Too far ahead of renderer, waiting for it.\n");
+
+			while (exp->stepsahead.value > R_toofar / 2 && readmutexint(&exp->run))
+				pthread_cond_wait(&exp->signal, &exp->stepsahead.mutex), ++T->waits;
+
+			T->wait += seconds() - u;
+		}
+
+		pthread_mutex_unlock(&exp->stepsahead.mutex);
 
-		if (!mkframe(exp, frame))
+		if (!readmutexint(&exp->run))
+			break;
+
+		t = seconds();
+		checkpoint(exp, n);
+		T->checkpoint += (u = seconds()) - t;
+		f = T->forces;
+
+		if (!(steps = mkframe(exp, &exp->frame[slot], n)))
 		{
 			warn(WL_verbose, "compiler", "Got error in (mkframe); sending signals to stop.\n");
-			setmutexint(&threads_run, 0);
-			pthread_mutex_unlock(&compiler_mutex);
+			stopthreads(exp);
 
 			break;
 		}
 
-		incmutexint(&C_stepsahead);
-		pthread_mutex_unlock(&compiler_mutex);
+		t = seconds() - u;
+		elapsed += t, T->frames += steps;
+		T->step += t - (T->forces - f);
+
+		/* the renderer only waits while there are no frames */
+		t = seconds();
+		pthread_mutex_lock(&exp->stepsahead.mutex);
+		T->lock += seconds() - t;
+
+		if (exp->stepsahead.value++ == 0)
+			pthread_cond_signal(&exp->signal);
+
+		T->buffered += exp->stepsahead.value;
+
+		if (exp->stepsahead.value > T->maxbuffered)
+			T->maxbuffered = exp->stepsahead.value;
+
+		exp->stats.shared = *T;
+		pthread_mutex_unlock(&exp->stepsahead.mutex);
 	}
 
+	freepool(exp);
+
+	if (T->frames != 0)
+		warn(WL_verbose, "compiler", "Compiled %i frames at %e pair interactions per second.\n",
+		    T->frames, (long double)exp->nobjects * (exp->nobjects - 1) * T->frames / elapsed);
+
+	usage("compiler", handed(exp, T), T->waits);
+
 	warn(WL_verbose, "compiler", "Terminated.\n");
 
 	return NULL;
 }
 
+/* writeheader: Write the header of the binary output of (exp) to (f). Returns 0 on failure, and 1 on success. */
+static int writeheader(struct exp *exp, FILE *f)
+{
+	struct header header;
+
+	/* zero the padding, so that output does not depend on the stack */
+	memset(&header, 0, sizeof(struct header));
+
+	memcpy(header.magic, B_MAGIC, sizeof(B_MAGIC));
+	header.version = B_VERSION;
+	header.realsize = exp->realsize;
+	header.dimensions = DIM;
+	header.nobjects = exp->nobjects;
+	header.fields = exp->fields;
+	header.limit = exp->limit;
+	header.delta = exp->delta;
+	strcpy(header.title, exp->title);
+
+	return fwrite(&header, sizeof(struct header), 1, f) == 1;
+}
+
+/* putreal: Write (x) at (p) as a real of (size) bytes; those of the build, or of a float or a double. Returns the
+ * byte after it.
+ */
+static unsigned char *putreal(unsigned char *p, real x, int size)
+{
+	float f;
+	double d;
+
+	if (size == B_REALSIZE)
+		memcpy(p, &x, B_REALSIZE);
+	else
+	if (size == sizeof(float))
+		f = (float)x, memcpy(p, &f, sizeof(float));
+	else
+		d = (double)x, memcpy(p, &d, sizeof(double));
+
+	return p + size;
+}
+
+/* writeframe: Write the record of (frame) to (f), using (record) to build it; (record) must be large enough for
+ * a record of (exp). Returns 0 on failure, and 1 on success.
+ */
+static int writeframe(struct exp *exp, struct frame *frame, unsigned char *record, FILE *f)
+{
+	unsigned char *p = record;
+	vector *s = frame->system, *end = s + (size_t)exp->nobjects * exp->nfields;
+
+	memcpy(p, &frame->n, sizeof(int));
+	p += sizeof(int);
+
+	for (; s < end; ++s)
+	{
+		p = putreal(p, s->x, exp->realsize);
+		p = putreal(p, s->y, exp->realsize);
+		D3(p = putreal(p, s->z, exp->realsize);)
+	}
+
+	return fwrite(record, p - record, 1, f) == 1;
+}
+
+/* report: Write a line of the stats of (exp) to stderr, as they were at (now), with the tally of the compiler as
+ * it was last handed over, (C).
+ */
+static void report(struct exp *exp, const struct tally *C, double now)
+{
+	const struct tally *R = &exp->stats.renderer;
+
+	warn(WL_none, "stats", "t=%e stepped=%i rendered=%i buffered=%i forces=%e nforces=%e step=%e checkpoint=%e"
+	    " clock=%e cwait=%e write=%e bytes=%e rlock=%e rwait=%e path=%a\n",
+	    (long double)(now - exp->stats.begin), C->frames, R->frames, handed(exp, C) - R->frames,
+	    (long double)C->forces, (long double)C->nforces, (long double)C->step, (long double)C->checkpoint,
+	    (long double)C->lock, (long double)C->wait, (long double)R->write, (long double)R->bytes,
+	    (long double)R->lock, (long double)R->wait, exp->path);
+}
+
 void *renderer(void *arg)
 {
 	struct exp *exp = (struct exp *)arg;
-	struct frame *frame, *next;
-	int catchup = 0, i = 0, j;
+	static const char *names[F_COUNT] = { F_NAMES };
+	struct tally *T = &exp->stats.renderer, C;
+	struct frame *frame;
+	int slot, j, k, next, last, x;
+	unsigned char *record = NULL;
+	double t, u;
+	vector *s;
 
 	warn(WL_verbose, "renderer", "Initialized.\n");
 
-	for (frame = exp->frame; readmutexint(&threads_run); frame = next)
+	if (exp->binary && exp->fields != 0)
 	{
-		pthread_mutex_lock(&renderer_mutex);
-		pthread_mutex_lock(&C_stepsahead.mutex);
-
-		if (catchup)
+		if ((record = malloc(sizeof(int) + (size_t)exp->nobjects * exp->nfields * DIM * exp->realsize)) == NULL)
 		{
-			if (C_stepsahead.value < 3)
-			/* caught up */
-			{
-				warn(WL_verbose, "renderer", "Caught up to compiler, unlocking it.\n");
-				catchup = 0;
-				pthread_mutex_unlock(&compiler_mutex);
-			}
+			warn(WL_crash, "renderer", "malloc returned NULL when attempting allocation of a frame record; sending signals to stop.\n");
+			stopthreads(exp);
 		} else
-		if (C_stepsahead.value == R_toofar)
-		/* start catching up */
+		if (!writeheader(exp, exp->out))
 		{
-			warn(WL_verbose, "renderer", "Too far behind compiler, locking it.\n");
-			catchup = 1;
-			pthread_mutex_lock(&compiler_mutex);
+			warn(WL_fail, "renderer", "Could not write the header of the output; sending signals to stop.\n");
+			stopthreads(exp);
 		} else
-		if (C_stepsahead.value < 2)
-		/* wait for compiler */
+			T->bytes += sizeof(struct header);
+	}
+
+	for (slot = 0; readmutexint(&exp->run); slot = (slot + 1) % R_toofar)
+	{
+		frame = &exp->frame[slot];
+
+		t = seconds();
+		pthread_mutex_lock(&exp->stepsahead.mutex);
+		T->lock += (u = seconds()) - t;
+
+		if (exp->stepsahead.value == 0)
 		{
 			warn(WL_verbose, "renderer", "No frame prepared yet, waiting for compiler.\n");
-			pthread_mutex_unlock(&C_stepsahead.mutex);
 
-			for (;;)
+			/* sleep until the compiler has prepared a frame */
+			while (exp->stepsahead.value == 0 && readmutexint(&exp->run))
+				pthread_cond_wait(&exp->signal, &exp->stepsahead.mutex), ++T->waits;
+
+			T->wait += seconds() - u;
+		}
+
+		pthread_mutex_unlock(&exp->stepsahead.mutex);
+
+		if (!readmutexint(&exp->run))
+			break;
+
+		t = seconds();
+
+		if (exp->fields == 0)
+		/* nothing is rendered */
+			;
+		else
+		if (exp->binary)
+		{
+			if (!writeframe(exp, frame, record, exp->out))
 			{
-				/* catch end of a compile loop */
-				catchmutex(&compiler_mutex);
-				pthread_mutex_lock(&C_stepsahead.mutex);
+				warn(WL_fail, "renderer", "Could not write frame %i; sending signals to stop.\n", frame->n);
+				stopthreads(exp);
 
-				if (C_stepsahead.value >= 2)
-					break;
+				break;
+			}
+
+			T->bytes += sizeof(int) + (double)exp->nobjects * exp->nfields * DIM * exp->realsize;
+		} else {
+			x = fprintf(exp->out, "frame %d:\n", frame->n);
+
+			for (j = 0, s = frame->system; j < exp->nobjects; ++j)
+			{
+				x += fprintf(exp->out, "\t" "object %d:\n", j);
+
+				for (k = 0; k < F_COUNT; ++k)
+					if (exp->fields & (1 << k))
+						x += fprintf(exp->out, "\t\t" "%s: (%Le, %Le" D3(", %Le") ")\n", names[k], (long double)s->x,
+						    (long double)s->y D3(, (long double)s->z)), ++s;
 
-				pthread_mutex_unlock(&C_stepsahead.mutex);
+				/* kept from overflowing for large frames */
+				T->bytes += x, x = 0;
 			}
 
-			warn(WL_verbose, "renderer", "Frame prepared; rendering.\n");
+			T->bytes += x;
 		}
 
-		pthread_mutex_unlock(&C_stepsahead.mutex);
+		T->write += seconds() - t;
+
+		/* the slot may be filled again as soon as it is handed back, so whether it was the last is read before */
+		next = frame->n + exp->stride;
+		last = next > exp->limit;
+
+		/* hand the slot back to the compiler; once it has found every slot full, it waits for half of them */
+		t = seconds();
+		pthread_mutex_lock(&exp->stepsahead.mutex);
+		T->lock += seconds() - t;
 
-		if (++i > exp->limit)
+		if (--exp->stepsahead.value == R_toofar / 2)
+			pthread_cond_signal(&exp->signal);
+
+		C = exp->stats.shared;
+		pthread_mutex_unlock(&exp->stepsahead.mutex);
+		++T->frames;
+		rendered(exp, next);
+
+		if (exp->stats.every != 0 && (t = seconds()) - exp->stats.last >= exp->stats.every)
+			report(exp, &C, t), exp->stats.last = t;
+
+		if (last)
 		{
 			warn(WL_verbose, "renderer", "Limit of %i reached; breaking from loop and sending signals to stop.\n", exp->limit);
-			setmutexint(&threads_run, 0);
-			pthread_mutex_unlock(&renderer_mutex);
+			stopthreads(exp);
 
 			break;
 		}
+	}
+
+	free(record);
+	fflush(exp->out);
+
+	usage("renderer", T->frames, T->waits);
+
+	warn(WL_verbose, "renderer", "Terminated.\n");
+
+	return NULL;
+}
+
+/* summarize: Warn of the stats of (exp), once its compiler and renderer have been joined; as information if they
+ * are to be reported, or otherwise only if verbose.
+ */
+static void summarize(struct exp *exp)
+{
+	const struct tally *C = &exp->stats.compiler, *R = &exp->stats.renderer;
+	long double total = seconds() - exp->stats.begin;
+	int level = exp->stats.report ? WL_info : WL_verbose, nhanded = handed(exp, C);
+
+	if (total <= 0)
+		total = 1e-9L;
+
+	warn(level, "stats", "%a: %i frames stepped and %i rendered in %e s, %e frames per second.\n",
+	    exp->title, C->frames, R->frames, total, C->frames / total);
+	warn(level, "stats", "compiler: forces %e s (%e%%), %i times; stepping %e s (%e%%); checkpoints %e s (%e%%).\n",
+	    (long double)C->forces, 100 * C->forces / total, (int)C->nforces,
+	    (long double)C->step, 100 * C->step / total, (long double)C->checkpoint, 100 * C->checkpoint / total);
+	warn(level, "stats", "compiler: waited for the renderer %e s (%e%%), %i times; locking %e s.\n",
+	    (long double)C->wait, 100 * C->wait / total, C->waits, (long double)C->lock);
+	warn(level, "stats", "renderer: writing %e s (%e%%), %e bytes at %e bytes per second.\n",
+	    (long double)R->write, 100 * R->write / total, (long double)R->bytes,
+	    R->write > 0 ? R->bytes / R->write : 0.0L);
+	warn(level, "stats", "renderer: waited for the compiler %e s (%e%%), %i times; locking %e s.\n",
+	    (long double)R->wait, 100 * R->wait / total, R->waits, (long double)R->lock);
+	warn(level, "stats", "frames buffered: %e on average, at most %i of %i.\n",
+	    nhanded > 0 ? C->buffered / nhanded : 0.0L, C->maxbuffered, R_toofar);
+
+	/* whichever waited less on the other is the one the run waits on */
+	if (C->frames != 0)
+		warn(level, "stats", "Limited by the %a.\n", R->wait >= C->wait ? "compiler" : "renderer");
+}
 
-		printf("frame %d:\n", i);
+/* freestream: Free the mutexes and condition of the frame-stream of (exp). */
+static void freestream(struct exp *exp)
+{
+	pthread_mutex_destroy(&exp->run.mutex);
+	pthread_mutex_destroy(&exp->stepsahead.mutex);
+	pthread_cond_destroy(&exp->signal);
+}
 
-		for (j = 0; j < exp->nobjects; ++j)
-			printf("\t" "object %d:\n"
-			       "\t\t" "felec: (%Le, %Le)\n"
-			       "\t\t" "fgrav: (%Le, %Le)\n"
-			       "\t\t" "acc: (%Le, %Le)\n"
-			       "\t\t" "vel: (%Le, %Le)\n"
-			       "\t\t" "loc: (%Le, %Le)\n",
-			    j, frame->system[j].felec.x, frame->system[j].felec.y,
-			       frame->system[j].fgrav.x, frame->system[j].fgrav.y,
-			       frame->system[j].acc.x, frame->system[j].acc.y,
-			       frame->system[j].vel.x, frame->system[j].vel.y,
-			       frame->system[j].loc.x, frame->system[j].loc.y);
+int runexp(struct exp *exp)
+{
+	pthread_t compiler_thread, renderer_thread;
+	int pthreadr;
+
+	pthread_mutex_init(&exp->run.mutex, NULL);
+	pthread_mutex_init(&exp->stepsahead.mutex, NULL);
+	pthread_cond_init(&exp->signal, NULL);
+	exp->run.value = 1;
+	exp->stepsahead.value = 0;
+	memset(&exp->stats.compiler, 0, sizeof(struct tally));
+	exp->stats.renderer = exp->stats.shared = exp->stats.compiler;
+	exp->stats.begin = exp->stats.last = seconds();
+
+	if (!mkwriter(exp))
+	{
+		freestream(exp);
 
-		decmutexint(&C_stepsahead);
-		incmutexint(&R_discardable);
+		return 0;
+	}
 
-		/* assume the discarding of this frame is instant */
-		next = frame->next;
+	if ((pthreadr = pthread_create(&compiler_thread, NULL, compiler, (void *)exp)))
+	{
+		warn(WL_fail, "runexp", "Could not create thread for the compiler, (pthread_create) returned %i.\n", pthreadr);
+		freewriter(exp);
+		freestream(exp);
 
-		pthread_mutex_unlock(&renderer_mutex);
+		return 0;
 	}
-rend_main_end:
 
-	if (catchup)
+	if ((pthreadr = pthread_create(&renderer_thread, NULL, renderer, (void *)exp)))
 	{
-		warn(WL_verbose, "renderer", "Was attempting to catch up to compiler before termination, unlocking it now so it may exit naturally.\n");
-		catchup = 0;
-		pthread_mutex_unlock(&compiler_mutex);
+		warn(WL_fail, "runexp", "Could not create thread for the renderer, (pthread_create) returned %i.\n", pthreadr);
+
+		stopthreads(exp);
+		pthread_join(compiler_thread, NULL);
+		freewriter(exp);
+		freestream(exp);
+
+		return 0;
 	}
 
-	warn(WL_verbose, "renderer", "Terminated.\n");
+	pthread_join(compiler_thread, NULL);
+	pthread_join(renderer_thread, NULL);
+	freewriter(exp);
+	freestream(exp);
+	summarize(exp);
 
-	return NULL;
+	return 1;
 }
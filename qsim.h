@@ -21,13 +21,63 @@
 #define NM   (1.67492716e-27)  /* Neutron Mass (kg) */
 #define EM   (9.10938188e-31)  /* Electron Mass (kg) */
 
-/* real type */
+/* real type; long double, unless built with PRECISION=double or PRECISION=float
+ * powr, sqrtr, fabsr, floorr, expr, erfcr, sinr, cosr: the functions of <math.h> for the real type
+ * strtor: the function of <stdlib.h> that converts a string to the real type
+ * expd: exp(), by a name that is not hidden by the experiment structures named (exp); only with PRECISION=double
+ */
+#if defined(PRECISION_float)
+typedef float real;
+#define powr(_x, _y)  powf((_x), (_y))
+#define sqrtr(_x)     sqrtf((_x))
+#define fabsr(_x)     fabsf((_x))
+#define floorr(_x)    floorf((_x))
+#define expr(_x)      expf((_x))
+#define erfcr(_x)     erfcf((_x))
+#define sinr(_x)      sinf((_x))
+#define cosr(_x)      cosf((_x))
+#define strtor(_s, _e)  strtof((_s), (_e))
+#elif defined(PRECISION_double)
+typedef double real;
+#define powr(_x, _y)  pow((_x), (_y))
+#define sqrtr(_x)     sqrt((_x))
+#define fabsr(_x)     fabs((_x))
+#define floorr(_x)    floor((_x))
+#define expr(_x)      expd((_x))
+#define erfcr(_x)     erfc((_x))
+#define sinr(_x)      sin((_x))
+#define cosr(_x)      cos((_x))
+#define strtor(_s, _e)  strtod((_s), (_e))
+double expd(double x);
+#else
 typedef long double real;
+#define powr(_x, _y)  powl((_x), (_y))
+#define sqrtr(_x)     sqrtl((_x))
+#define fabsr(_x)     fabsl((_x))
+#define floorr(_x)    floorl((_x))
+#define expr(_x)      expl((_x))
+#define erfcr(_x)     erfcl((_x))
+#define sinr(_x)      sinl((_x))
+#define cosr(_x)      cosl((_x))
+#define strtor(_s, _e)  strtold((_s), (_e))
+#endif
+
+/* dimensions of space; 2, unless built with DIMENSIONS=3, in which every vector has a z-component too
+ * D3: the arguments, in a build of three dimensions, or nothing in one of two; for the z-components of anything
+ * that has an x- and a y-component, so that a build of two dimensions is as it would be without them
+ */
+#if defined(DIMENSIONS_3)
+#define DIM  3
+#define D3(...)  __VA_ARGS__
+#else
+#define DIM  2
+#define D3(...)
+#endif
 
 /* vector type */
 typedef struct vector
 {
-	real x, y;
+	real x, y D3(, z);
 } vector;
 
 /* mutual-exclusion-integer type */
@@ -37,26 +87,192 @@ struct mutexint
 	int value;
 };
 
+/* barrier type; holds threads until (nthreads) of them are waiting */
+struct barrier
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int count, nthreads, generation;
+};
+
 /* datum structure */
 struct datum
 {
 	real value;
 	const char **units;
 	int nunits, unit;
+
+	/* list: the values and units of a list or range read in place of a single datum, with size (nlist), or 0 if a
+	 * single datum was read; (value) and (unit) are those of the first. (list) has room for (size) of them, and
+	 * (range) is if it is a range, of its first, last, and number of values. */
+	real *list;
+	int *lunits, nlist, size, range;
 };
 
-/* experiment structure */
+/* fields of an object in a frame, as a mask; in the order they are rendered */
+#define F_felec  0x01
+#define F_fgrav  0x02
+#define F_acc    0x04
+#define F_vel    0x08
+#define F_loc    0x10
+#define F_all    0x1f
+#define F_COUNT  5
+#define F_NAMES  "felec", "fgrav", "acc", "vel", "loc"
+
+/* routines; the quadtrees are octrees in three dimensions */
+#define RT_direct     0  /* every object against every other object */
+#define RT_barneshut  1  /* objects against a quadtree of cells, opened by (theta) */
+#define RT_symmetric  2  /* every pair of objects once, with equal and opposite forces */
+#define RT_fmm        3  /* expansions of the boxes of a uniform quadtree, to (order) */
+#define RT_cutoff     4  /* every object against the objects within (cutoff), through neighbour lists */
+#define RT_ewald      5  /* every object against every image of every object in a periodic (box), by Ewald's sums */
+#define RT_pm         6  /* charges and masses spread over a mesh, and summed over it by fast Fourier transforms */
+
+/* integrators; how objects are stepped from the forces on them */
+#define IN_euler    0  /* semi-implicit Euler; velocities from forces, then locations from the new velocities */
+#define IN_verlet   1  /* velocity Verlet; a half step of velocity on either side of a whole step of location */
+#define IN_yoshida  2  /* Yoshida's fourth-order composition of three velocity Verlet steps */
+#define IN_rk4      3  /* classical fourth-order Runge-Kutta */
+
+/* time steps; how (delta) is divided into the steps that objects are stepped by */
+#define TS_fixed     0   /* every object is stepped by (delta) */
+#define TS_adaptive  1   /* every object is stepped together, by steps chosen for (tolerance) */
+#define TS_block     2   /* every object is stepped by its own power-of-two fraction of (delta), chosen for (tolerance) */
+#define TS_MAXLEVEL  16  /* the shortest step is (delta / 2^TS_MAXLEVEL) */
+
+/* orders of the expansions of the fmm routine; by default, and at most */
+#define FMM_ORDER     4
+#define FMM_MAXORDER  16
+
+/* skin of the neighbour lists of the cutoff and ewald routines, as a fraction of (cutoff); objects may move half of
+ * it before the lists are built again */
+#define CU_SKIN  0.25
+
+/* the ewald routine splits each force into a sum near each object and a sum over waves, each of which leaves out
+ * about erfc(EW_SPLIT) of it, and uses the split of EW_REFERENCE for the reference that (accuracy) compares with */
+#define EW_SPLIT      3.5
+#define EW_REFERENCE  5.5
+
+/* cells along each side of the mesh of the pm routine, at least and at most; it is a power of two */
+#define PM_MINMESH  4
+#if DIM == 3
+#define PM_MAXMESH  256
+#else
+#define PM_MAXMESH  4096
+#endif
+
+/* PM_valid: Return if (_m) is a number of cells that the mesh of the pm routine may have along each side. */
+#define PM_valid(_m)  ((_m) >= PM_MINMESH && (_m) <= PM_MAXMESH && (_m) == (int)(_m) && ((int)(_m) & ((int)(_m) - 1)) == 0)
 
+/* keys that may be swept over; SW_system is a field of an object, in the order of the system */
+#define SW_delta      0
+#define SW_limit      1
+#define SW_theta      2
+#define SW_order      3
+#define SW_tolerance  4
+#define SW_softening  5
+#define SW_encounter  6
+#define SW_cutoff     7
+#define SW_screening  8
+#define SW_mesh       9
+#define SW_system     10
+#define SW_NAMES      "delta", "limit", "theta", "order", "tolerance", "softening", "encounter", "cutoff", "screening", \
+                      "mesh"
+
+/* sizes of the arrays of an experiment structure */
 #define exp_TITLESIZE  256
 #define exp_PATHSIZE   1024
 
+/* binary output: a header structure, then a record for every frame rendered; a record is the frame's number as
+ * an (int), followed by the (dimensions) components of every field in (fields) of every object, as reals of size
+ * (realsize) bytes, all in the byte order of the machine that wrote them. The 80-bit long double of x86 is
+ * written without its padding, so (realsize) is 10 for it. Version 1 had no (dimensions), and was always of two.
+ */
+#define B_MAGIC    "qsimbin"
+#define B_VERSION  2
+
+struct header
+{
+	char magic[8];
+	int version, realsize, dimensions;
+	int nobjects, fields, limit;
+	long double delta;
+	char title[exp_TITLESIZE];
+};
+
+/* system files: a header structure, then the x-, y- (and z-) components of the locations, then of the velocities,
+ * then the charges and then the masses of every object, each as an array of doubles with size (nobjects), in units
+ * of m, m/s, C and kg, in the byte order of the machine that wrote them; the components are those of the build, so
+ * a system file is only read by a build of as many dimensions as wrote it. A system file that does not begin with
+ * (SF_MAGIC) is read as text, with an object on every line as its SF_COLUMNS numbers in the same units separated
+ * by commas; lines that are blank, or begin with `#', are skipped.
+ */
+#define SF_MAGIC    "qsimsys"
+#define SF_VERSION  1
+#define SF_COLUMNS  (2 * DIM + 2)
+
+struct sysheader
+{
+	char magic[8];
+	int version, nobjects;
+};
+
+/* checkpoints: a header structure, then the locations, velocities, charges, masses and forces of every object, as
+ * the arrays of the particles structure, in the order they are declared; for block time steps, these are followed
+ * by the accelerations and their changes over time, and then by the levels. Reals are of size (realsize) bytes,
+ * with their padding, and a checkpoint may only be resumed by a build of the same precision on the same machine.
+ */
+#define CK_MAGIC    "qsimck"
+#define CK_VERSION  5
+#define CK_EVERY    1000  /* frames between checkpoints, by default */
+
+struct ckheader
+{
+	char magic[8];
+	int version, realsize, dimensions;
+	int nobjects, n, limit;  /* (n) is the frame the state is at, before it is rendered */
+	int routine, order, mesh, integrator, timestep, fresh;
+	real delta, theta, softening, tolerance, encounter, cutoff, screening, h;
+	vector box;
+	char title[exp_TITLESIZE];
+};
+
+/* experiment structure */
 struct exp
 {
 	char title[exp_TITLESIZE], path[exp_PATHSIZE];
 	real delta;
 	int limit;
+	int begin;  /* number of the first frame compiled; 1, unless resumed from a checkpoint */
 
-	/* system: linked-list of object structures */
+	/* output: if frames are rendered in the binary format rather than as text, and the bytes of each real written
+	 * in it, which may be fewer than those of the build; the fields rendered and the number of them, and the number
+	 * of frames between those rendered; nothing is rendered if (fields) is 0 */
+	int binary, realsize, fields, nfields, stride;
+
+	/* routine used to calculate forces, and its parameters; and the softening length of every pair, or 0 */
+	int routine;
+	real theta;
+	int order, mesh;
+	real softening;
+
+	/* integrator used to step objects from the forces on them, how (delta) is divided into steps, and the error
+	 * allowed in a step that is not fixed */
+	int integrator, timestep;
+	real tolerance;
+
+	/* distance within which two objects that attract are stepped as a pair in an encounter, or 0 */
+	real encounter;
+
+	/* distance past which the cutoff routine sums no force; and the Debye length that electric forces are screened
+	 * by, as Yukawa's potential exp(-r / screening) / r, or 0 for none */
+	real cutoff, screening;
+
+	/* size of the periodic box that objects are wrapped into, with a corner at the origin, or 0 for open space */
+	vector box;
+
+	/* system: linked-list of object structures, as read by (readexp); moved into (particles) by (initexp), unless there
+	 * is none, as for the runs of a sweep, which are filled by the caller */
 	struct object
 	{
 		/* data ordered as is read from file */
@@ -66,16 +282,279 @@ struct exp
 	} *system;
 	int nobjects;
 
-	/* frame-stream: linked-list of frame structures */
+	/* sweep: list of the keys, and fields of objects, that are swept over, in the order they were read, or NULL; the
+	 * experiment is run once for every combination of their values, (nruns) times, the last varying fastest. The
+	 * values of the first run are those of the experiment structure itself. */
+	struct sweep
+	{
+		int key;            /* SW_ key */
+		int object, field;  /* if (key) is SW_system, the index of the object and of its field */
+		real *values;       /* values, with size (nvalues), in the units the experiment structure holds them in */
+		int nvalues;
+		struct sweep *next;
+	} *sweep;
+	int nruns;
+
+	/* source: the system file mapped into memory by (readexp), in place of (system), and read straight into
+	 * (particles) by (initexp); its size in bytes, and if it is binary rather than text */
+	struct source
+	{
+		char path[exp_PATHSIZE];
+		const char *map;
+		size_t size;
+		int binary;
+	} source;
+
+	/* frame-stream: ring of frame structures with size (R_toofar), one for every frame rendered; the compiler
+	 * fills the slots in order, and the renderer hands each back once it has been rendered */
 	struct frame
 	{
-		/* system: array of snapshot structure with size (nobjects) */
-		struct snapshot
-		{
-			vector felec, fgrav, acc, vel, loc;
-		} *system;
-		struct frame *next;
+		int n;  /* number of the frame */
+		/* system: array of vectors with size (nobjects * nfields); the fields in (fields) of every object, in the
+		 * order of the F_ masks */
+		vector *system;
 	} *frame;
+
+	/* the compiler and renderer of the frame-stream: (run) is 0 once they are to stop, (stepsahead) is the number
+	 * of frames compiled but not yet rendered, and (signal) is signalled when it changes or when they are to stop;
+	 * every experiment has its own, so that many may run at once. Frames are rendered to (out); stdout, unless run
+	 * in a batch. */
+	struct mutexint run, stepsahead;
+	pthread_cond_t signal;
+	FILE *out;
+
+	/* stats: counters and timers of the frame-stream, in seconds of wall time since (begin). The compiler and the
+	 * renderer each keep a tally of their own, and the compiler copies its tally into (shared) whenever it hands
+	 * over a frame, while holding (stepsahead), so that the renderer may read it. A summary is warned of when the
+	 * run ends, whatever the verbosity if (report); and if (every) is not 0, the renderer writes a line of them to
+	 * stderr once a frame has been rendered at least (every) seconds after the last line. */
+	struct stats
+	{
+		double every, begin, last;
+		int report;
+		struct tally
+		{
+			int frames;                       /* frames stepped by the compiler, or rendered */
+			long nforces;                     /* times (forces) was called */
+			double forces, step, checkpoint;  /* compiler: calculating forces, the rest of (mkframe), checkpoints */
+			double write, bytes;              /* renderer: formatting and writing frames, and bytes written */
+			double lock, wait;                /* acquiring (stepsahead), and waiting on (signal), (waits) times */
+			int waits;
+			double buffered;                  /* compiler: sum of the frames buffered after each hand-over */
+			int maxbuffered;
+		} compiler, renderer, shared;
+	} stats;
+
+	/* particles: the system as arrays with size (nobjects), which the routines and kinematics work over */
+	struct particles
+	{
+		real *x, *y, D3(*z,) *vx, *vy, D3(*vz,) *charge, *mass;
+		/* forces from the last call to (forces); electric (fex, fey) and gravitational (fgx, fgy) */
+		real *fex, *fey, D3(*fez,) *fgx, *fgy D3(, *fgz);
+		int fresh;  /* if the forces are those of the current locations, so need not be calculated again */
+
+		/* the locations and velocities at the beginning of a step, and the weighted sums of their derivatives
+		 * over its stages; only allocated for the rk4 integrator, and (x0) owns the memory of them all */
+		real *x0, *y0, D3(*z0,) *vx0, *vy0, D3(*vz0,) *dx, *dy, D3(*dz,) *dvx, *dvy D3(, *dvz);
+
+		/* adaptive time steps: the locations, velocities and forces at the beginning of a step, to return to if
+		 * its error is too large, in the order above; and the length of the last step taken */
+		real *save, h;
+
+		/* block time steps: the acceleration at the beginning of every object's step, and its change over time;
+		 * the level of every object, whose step is (delta / 2^level), or -1 until they are first chosen; and the
+		 * (nactive) objects whose forces are to be calculated. (ax) owns the memory of the reals, and (level) of
+		 * the integers. */
+		real *ax, *ay, D3(*az,) *jx, *jy D3(, *jz);
+		int *level, *active, nactive;
+
+		/* encounters: the object every object is paired with for the step being taken, or -1, and the nearest
+		 * object it could be paired with; objects are found through a grid of cells as wide as (encounter),
+		 * hashed into (nhead) lists that begin at (head) and continue through (chain). (partner) owns the memory
+		 * of them all. */
+		int *partner, *nearest, *head, *chain, nhead;
+	} particles;
+
+	/* tree: quadtree used by the Barnes-Hut routine, rebuilt every frame; an octree in three dimensions */
+	struct tree
+	{
+		/* cells: array of cell structures with size (size), of which (ncells) are in use; the root is at 0 */
+		struct cell
+		{
+			vector center;        /* geometric center of the cell */
+			real half;            /* half of the cell's width */
+			real charge, mass;    /* monopole moments */
+			vector qdip, mdip;    /* dipole moments about (center) */
+			int child[1 << DIM];  /* indices of the quadrants, or -1; a cell without quadrants is a leaf */
+			int first, count;     /* objects in a leaf, linked through (next) */
+		} *cells;
+		int ncells, size;
+
+		/* next: index of the next object in the same leaf, or -1 */
+		int *next;
+	} tree;
+
+	/* lists: neighbour lists used by the cutoff and ewald routines, rebuilt only once an object has moved more than
+	 * half of the skin, CU_SKIN of (cutoff), since they were last built */
+	struct lists
+	{
+		/* the neighbours of object (i), within (cutoff) and the skin when the lists were built, in order, are at
+		 * (index) from (start[i]) up to (start[i + 1]), by their place in (sorted); (index) has room for (size) */
+		long *start, size;
+		int *index;
+		real *x0, *y0 D3(, *z0);  /* locations of the objects when the lists were built */
+
+		/* locations, charges and masses of the objects in the order of (sorted), copied before forces are
+		 * calculated, so that neighbours are read from memory near each other */
+		real *x, *y, D3(*z,) *charge, *mass;
+		int built;      /* if the lists have been built */
+		long builds;    /* times the lists were built */
+
+		/* grid of cells at least as wide as the cutoff and skin, used to build the lists; (width) by (height) (by
+		 * (depth)), and wrapped around (columns * rows (* layers)) lists, so that cells far apart may share a list,
+		 * and cells side by side are in lists side by side. In open space, the grid is a square (or cube) of a
+		 * power of two lists; in a periodic box, it fits the box, so that the first and last columns and rows are
+		 * side by side as the box wraps. The objects of list (c) are at (sorted) from (cell[c]) up to (cell[c + 1]),
+		 * in order, and (of) is the list of every object. (x0) owns the memory of (y0) and those copied, and
+		 * (sorted) that of (of) and (cell). */
+		int *cell, *sorted, *of, columns, rows D3(, layers);
+		real width, height D3(, depth);
+	} lists;
+
+	/* ewald: the sum over waves of the ewald routine, of the waves (2 pi a / box.x, 2 pi b / box.y) from a = 0 up
+	 * to (na), and b = -(nb) up to (nb), as (a * (2 nb + 1) + nb + b); of which only those with a > 0, or a = 0
+	 * and b > 0, are summed, as the others are the same waves going the opposite way. In three dimensions, the
+	 * waves (2 pi a / box.x, 2 pi b / box.y, 2 pi c / box.z) are numbered ((a * (2 nb + 1) + nb + b) * (2 nc + 1)
+	 * + nc + c), and only those with a > 0, or a = 0 and b > 0, or a = b = 0 and c > 0, are summed. The waves of
+	 * a column, of the same a (and b), are numbered together, and summed along their last component. */
+	struct ewald
+	{
+		real split, alpha;  /* split of the forces, and the width of the Gaussians they are split by */
+		int na, nb, D3(nc,) nwaves;
+
+		/* weight of every wave, or 0 if it is not summed; and the sums of the charges and masses, times the
+		 * cosine and the sine of the phase of the wave at each object, in the order (charge cos, charge sin, mass
+		 * cos, mass sin) */
+		real *weight, *sums;
+
+		/* phases of an object, exp(i 2 pi a x / box.x) and exp(i 2 pi b y / box.y) (and exp(i 2 pi c z / box.z)),
+		 * for every worker; each is (2 * (na + nb (+ nc) + DIM)) reals, the real and imaginary parts of each in turn */
+		real *phases;
+		int *span;  /* largest last component of the waves summed in every column, or -1; those of its negative are
+		             * the same */
+		int nworkers;
+
+		/* (split), (cutoff) and (box) the waves were made for, so that they are made again if these change */
+		real madefor[2 + DIM];
+	} ewald;
+
+	/* pm: mesh of the pm routine, of (n^DIM) points, (h) apart from a corner at (min); in a periodic box, it is the
+	 * box, and (n) is (cells), but in open space it is twice as wide as the square (or cube) of (cells) that the
+	 * objects are spread over, so that the sums over it do not wrap around. A point is numbered by its components,
+	 * the first varying fastest. */
+	struct pm
+	{
+		int cells, n;
+		vector min, h;
+		real alpha;  /* width of the Gaussians the forces are split by, if the forces near each object are summed */
+
+		/* rho: charges and masses at every point, as the real and imaginary parts of complex numbers, then their
+		 * transform, and then the y-components of their forces on a unit charge and mass at every point; (fx)
+		 * holds the x-components, and (fz) the z-components. (fx) owns the memory of (rho), (fz) and (green). */
+		real *fx, *rho D3(, *fz);
+
+		/* green: imaginary parts of the transforms of the x-, y- (and z-) components of the force of a unit
+		 * charge, in turn at every point; those of the waves of the box, or those of the mesh itself in open
+		 * space */
+		real *green;
+
+		/* cosines and sines of 2 pi k / n, for k up to n / 2; and a column of the mesh for every worker */
+		real *twiddles, *column;
+		int nworkers;
+
+		/* mesh being transformed by the workers, along the axis (axis), and the sign of the transform */
+		real *pass;
+		int axis, sign;
+
+		/* (mesh), (cutoff), (h) and (box) that the mesh and its green functions were made for */
+		real madefor[3 + DIM];
+	} pm;
+
+	/* fmm: uniform quadtree used by the fast multipole routine, with the objects sorted into its leaves every frame;
+	 * a box of level (l) is numbered by the interleaved bits of its column and row (and layer), (b), and its
+	 * expansions are at (((2^(DIM l) - 1) / (2^DIM - 1) + b) * 2 * ncoef), those of charge followed by those of
+	 * mass; an octree in three dimensions */
+	struct fmm
+	{
+		int levels;          /* level of the leaves; the root is level 0 */
+		int order, ncoef;    /* order the operators are made for, or -1; coefficients of each expansion */
+		vector min;          /* corner of the root box */
+		real width;          /* width of the root box */
+
+		/* start: index in the sorted objects of the first object of every leaf, and then of the end; (index) is
+		 * the index of every sorted object in the particles, and (leaf) that of every object's leaf */
+		int *start, *index, *leaf;
+		real *x, *y, D3(*z,) *charge, *mass;
+
+		/* multipole and local expansions of every box, in units of the box's width */
+		real *multipole, *local;
+
+		/* operators: multipole to multipole and local to local for each quadrant, the derivatives of 1 / r at every
+		 * offset of an interaction list, and the terms of multipole to local; and the exponents of x, y (and z) of
+		 * every coefficient, in turn */
+		real *m2m, *l2l, *derivs;
+		int *exponents;
+		struct term
+		{
+			int l, m, d;  /* indices of the local, multipole and derivative coefficients */
+			real c;
+		} *terms;
+		int nterms;
+
+		int level;  /* level the workers are working over */
+	} fmm;
+
+	/* pool: worker threads that share the compiler's work, each over its own range of objects; the compiler is
+	 * worker 0, so (threads) has size (nthreads - 1), and is NULL while the pool is not running */
+	struct pool
+	{
+		int nthreads;
+		pthread_t *threads;
+		struct barrier barrier;
+		void (*job)(struct exp *exp, int, int);
+		int byworker;         /* if (job) is given the worker's index, rather than its range of objects */
+		struct frame *frame;  /* frame being compiled */
+		real h;               /* length of the step being taken */
+		real kick, drift;     /* time that velocities and locations are stepped by in this stage of a step */
+		int stage;            /* stage of a step of the rk4 integrator */
+		int tick;             /* time into (delta) of block time steps, in steps of the last level */
+		int quit;
+
+		/* pull: sums of the symmetric routine for each worker, as arrays with size (nobjects) */
+		struct pull
+		{
+			real *qx, *qy, D3(*qz,) *mx, *my D3(, *mz);
+		} *pull;
+	} pool;
+
+	/* checkpoint: the state of the experiment, written to (path) every (every) frames, or never if it is 0, by a
+	 * writer thread of its own; the compiler copies the state into (state), with size (size), and the writer
+	 * writes it while the compiler carries on. A checkpoint is only put in place once the frames before it have
+	 * been rendered, so that a run resumed from it goes on from the last frame rendered. */
+	struct checkpoint
+	{
+		char path[exp_PATHSIZE];
+		int every, last;        /* frames between checkpoints; frame of the last checkpoint taken */
+		struct ckheader *state;
+		size_t size;
+		int pending;            /* frame of the checkpoint being written, or -1 if the writer is idle */
+		int flushed;            /* if the frames before it have been rendered */
+		int quit;
+		int running;            /* if (thread) is running */
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+	} checkpoint;
 };
 
 
@@ -87,13 +566,8 @@ struct exp
 extern int             W_verbose;
 extern pthread_mutex_t W_mutex;
 
-/* for use in all threads */
-extern struct mutexint threads_run;
-extern pthread_mutex_t compiler_mutex;
-extern struct mutexint C_stepsahead;
-extern pthread_mutex_t renderer_mutex;
-#define                R_toofar  8
-extern struct mutexint R_discardable;
+/* for use in the compiler and renderer */
+#define R_toofar  8  /* slots in the frame ring; frames the compiler may be ahead of the renderer */
 
 /*
  * functions
@@ -126,11 +600,8 @@ int cin(char c, const char *arr);
 
 void warn(int level, const char *name, const char *format, ...);
 
-/* readarr: Read into (arr) from (f) until a character from (term) is found, or until (arrsize) is reached.
- * catchmutex: Hold if (_mutex) is locked, then unlock it once it has been locked.
- */
+/* readarr: Read into (arr) from (f) until a character from (term) is found, or until (arrsize) is reached. */
 int readarr(FILE *f, const char *term, char *arr, int arrsize);
-#define catchmutex(_mutex)  pthread_mutex_lock(_mutex), pthread_mutex_unlock(_mutex)
 
 /* V_add: Return the vector sum of vectors (a) and (b).
  * V_mul: Return the vector resulting from the vector (a) times the multiplicand (mul).
@@ -138,15 +609,22 @@ int readarr(FILE *f, const char *term, char *arr, int arrsize);
  * V_div: Return the vector resulting from the vector (a) divided by the quotient (quo).
  * V_get: Return the magnitude of the vector (_a).
  * V_set: Return a vector with the same direction as (_a), but with the magnitude of (_mag).
- * V_make: Return a vector with the x-component (_x), and the y-component (_y).
+ * V_make: Return a vector with the x-component (_x), the y-component (_y), and the z-component (_z); which is not
+ * evaluated in two dimensions.
+ * V_least: Return the least component of the vector (_a).
  */
 vector V_add(vector a, vector b);
 vector V_mul(vector a, real mul);
 vector V_sub(vector a, vector b);
 vector V_div(vector a, real quo);
-#define V_get(_a)        (real)sqrt(powl((_a).x, 2) + powl((_a).y, 2))
-#define V_set(_a, _mag)  V_mul((_a), (real)(_mag) / V_get((_a)))
-#define V_make(_x, _y)   (vector){(real)(_x), (real)(_y)}
+#define V_get(_a)            (real)sqrt(powr((_a).x, 2) + powr((_a).y, 2) D3(+ powr((_a).z, 2)))
+#define V_set(_a, _mag)      V_mul((_a), (real)(_mag) / V_get((_a)))
+#define V_make(_x, _y, _z)   (vector){(real)(_x), (real)(_y) D3(, (real)(_z))}
+#if DIM == 3
+#define V_least(_a)          ((_a).x < (_a).y ? ((_a).x < (_a).z ? (_a).x : (_a).z) : ((_a).y < (_a).z ? (_a).y : (_a).z))
+#else
+#define V_least(_a)          ((_a).x < (_a).y ? (_a).x : (_a).y)
+#endif
 
 /* readmutexint: Return the integer value of (MI).
  * setmutexint: Return the integer value of (MI) after it has been set to (value).
@@ -158,6 +636,17 @@ int setmutexint(struct mutexint *MI, int value);
 int incmutexint(struct mutexint *MI);
 int decmutexint(struct mutexint *MI);
 
+/* stopthreads: Set (run) of (exp) to 0, and wake its compiler and renderer if either is waiting for the other. */
+void stopthreads(struct exp *exp);
+
+/* initbarrier: Initialize the barrier (B) to hold threads until (nthreads) of them are waiting.
+ * waitbarrier: Wait at the barrier (B) until (nthreads) threads are waiting at it, then release them all.
+ * freebarrier: Free the barrier (B).
+ */
+void initbarrier(struct barrier *B, int nthreads);
+void waitbarrier(struct barrier *B);
+void freebarrier(struct barrier *B);
+
 /* readdatum: Read a real number from file (f) into datum structure (datum). The number read will have its
  * unit converted using the standard metric multipliers, aswell as the index of its unit, in an array of
  * permitted units stored in the datum structure (datum), stored in the datum structure (datum); if the unit
@@ -168,7 +657,10 @@ int decmutexint(struct mutexint *MI);
  *
  * (sign)(whole component).(decimal component)e(scientific notation)(unit)
  * eg.,
- * 1, -1, +1, 1.0, -1.000e0, +1m, 1 m, -1e000cm, +1e000 cm, 1.000mm, -1.000 mm, etc.
+ * 1, -1, +1, 1.0, -1.000e0, +1m, 1 m, -1e000cm, +1E000 cm, 1.000mm, -1.000 mm, etc.
+ *
+ * The value is the real nearest to the datum as written, with its metric multiplier; as if it were written with
+ * the multiplier folded into its scientific notation, and read by (strtor).
  *
  * No component of the datum is necessary. If the whole component is excluded, then the value of 0 is assumed;
  * that is, preceeding any other provided components. If no component is provided, and it begins with alpha-
@@ -181,6 +673,9 @@ int decmutexint(struct mutexint *MI);
  * `nm': The mass of a neutron.
  * `em': The mass of an electron. 
  *
+ * In place of a datum, a list of data, `{a, b, c}', or a range, `{first : last : n}', may be read into the list of
+ * (datum); see (readexp).
+ *
  * (readdatum) will return the terminating character found from (f) in term, or -1 if EOF is reached.
  */
 int readdatum(FILE *f, const char *term, struct datum *datum);
@@ -231,24 +726,254 @@ void freedata(int ndatum, ...);
  * # if a unit is not specified, the default is assumed; the default unit for charge is the Coulomb (C),
  * # and the default unit for mass is the gram (g).
  *
+ * In a build of three dimensions, DIMENSIONS=3, every line holds 8 data instead; the location's z-component
+ * follows its y-component, and the velocity's z-component follows its y-component:
+ *
+ * # loc-x, loc-y, loc-z,  vel-x, vel-y, vel-z,  charge,  mass
+ *
  * system:
  * 0m, 0m,  0m/s, 0m/s,  +1e,  MP  # a proton, located at (0,0) with speed (0,0).
  * 1m, 1m,  0m/s, 0m/s,  -1e,  ME; # an electron, located at (1,1) with speed (0,0).
  *
  * Each datum is separated by a `,', and each object is separated by a new-line. The final object ends with
  * a `;' which terminates the system.
+ *
+ * Large systems are better given by the `system_file' key, in place of `system', as the path to a system file in
+ * one of the formats described above (SF_MAGIC); a relative path is taken from the directory of the experiment
+ * file. ie.,
+ *
+ * system_file: particles.bin;
+ *
+ * The `routine' key chooses how forces are calculated; `direct', `barnes-hut', `symmetric', `fmm', `cutoff',
+ * `ewald' or `pm'.
+ * `theta' sets the opening angle of the `barnes-hut' routine, and `order' the order of the expansions of the
+ * `fmm' routine, from 0 up to FMM_MAXORDER. ie.,
+ *
+ * routine: barnes-hut;
+ * theta: 0.5;
+ *
+ * The `softening' key sets a length (e) by which every pair force is softened, as a force of 1 / r^2 is softened to
+ * r / (r^2 + e^2)^(3/2), so that objects passing close to each other are not given accelerations too large for
+ * their steps. It is 0, for no softening, by default. Only objects summed one by one are softened; the far cells
+ * of `barnes-hut' and the expansions of `fmm' are not, which differs from softening them by a fraction of about
+ * (e / r)^2. ie.,
+ *
+ * softening: 1e-9m;
+ *
+ * The `integrator' key chooses how objects are stepped; `euler', `verlet', `yoshida' or `rk4'. The `timestep'
+ * key chooses how (delta) is divided into steps; `fixed', `adaptive' or `block', and `tolerance' sets the error
+ * allowed in each step of the latter two. ie.,
+ *
+ * integrator: verlet;
+ * timestep: adaptive;
+ * tolerance: 1e-4;
+ *
+ * The `encounter' key sets a distance within which two objects that attract, each the nearest of the other, are
+ * stepped as a pair; their motion about each other is solved exactly as if they were alone, and the forces of
+ * every other object on them are applied in half steps of velocity on either side of it, as the verlet integrator
+ * does. A close pair may then be stepped by steps much longer than its orbit. It is 0, for no encounters, by
+ * default. Steps with encounters are always taken this way, whatever the integrator, and encounters are not
+ * handled with `block' time steps. ie.,
+ *
+ * encounter: 1e-6m;
+ *
+ * The `cutoff' routine sums the forces on every object over the objects within the distance set by the `cutoff'
+ * key alone, which must then be given, from neighbour lists that are only built again once objects have moved
+ * far enough. The `screening' key sets a Debye length (l) by which electric forces are screened, as the potential
+ * 1 / r becomes exp(-r / l) / r; it is 0, for none, by default, and only the `direct' and `cutoff' routines screen
+ * forces. Gravity is not screened, though it is cut off. ie.,
+ *
+ * routine: cutoff;
+ * cutoff: 5um;
+ * screening: 1um;
+ *
+ * The `box' key sets the width and height of a periodic box, with a corner at (0, 0), as two data, or as one for a
+ * square; in three dimensions, its width, height and depth, as three data, or as one for a cube. The system is
+ * then repeated without end in every direction, and objects are wrapped back into the box once they leave it. Only
+ * the `cutoff' routine, over the nearest image of every object, and the `ewald' and `pm' routines, over every
+ * image, are allowed in a box, and `ewald' is only allowed in one; the cutoff with its skin must be within half of
+ * the box. The `ewald' routine sums the forces near each object over the objects within
+ * `cutoff', which is chosen for the least time if it is not given, and the rest over waves; encounters are not
+ * handled in a box, and it may not be swept over. ie.,
+ *
+ * routine: ewald;
+ * box: 1mm, 1mm;
+ *
+ * The `pm' routine sums the forces over a mesh with (mesh) cells along each side of it, a power of two from
+ * PM_MINMESH up to PM_MAXMESH, which is chosen if it is not given; in open space, or in a periodic box. Given a
+ * `cutoff', the forces near each object are summed over the objects within it, and the rest over the mesh. ie.,
+ *
+ * routine: pm;
+ * mesh: 256;
+ *
+ * The value of `delta', `limit', `theta', `order', `tolerance', `softening', `encounter', `cutoff', `screening'
+ * or `mesh', or any datum of an object in `system', may be swept over, as a list of values, `{a, b, c}', or as
+ * a range of (n) values from (first) to (last) evenly spaced, `{first : last : n}'. The experiment is then run
+ * once for every combination of the values of every sweep, by (runsweep). ie.,
+ *
+ * delta: {1ns, 2ns, 5ns};
+ * system:
+ * 0m, 0m,  0m/s, 0m/s,  {+1e : +4e : 4},  pm
+ *
  * (readexp) will return 0 on failure, and 1 on success.
  */
 int readexp(const char *path, struct exp *exp);
 
-/* freeexp: Free an experiment structure.
- * initexp: Initialize an experiment structure, preparing it for use in the compiler and renderer.
+/* mkexp: Make an empty experiment structure, with every option at its default; to be filled by (readexp).
+ * freeexp: Free an experiment structure.
+ * initexp: Initialize an experiment structure, preparing it for use in the compiler and renderer; the system is
+ * moved into the particles structure, and options that do not work together are warned of. Returns 0 on failure,
+ * and 1 on success.
  */
+void mkexp(struct exp *exp);
 void freeexp(struct exp *exp);
 int initexp(struct exp *exp);
 
-/* compiler: Compile frames for an experiment structure.
- * renderer: Render frames compiled by the compiler, then mark them as discardable.
+/* parallel: Run (job) over every object of (exp), split into equal ranges between the workers of its pool; or
+ * all on the calling thread if the pool is not running. Returns once every worker has finished its range.
+ * everyworker: Run (job) on every worker of the pool of (exp), given the index of the worker and the number of
+ * workers; or on the calling thread, as worker 0 of 1, if the pool is not running.
+ * mkpool: Start the worker threads of the pool of (exp). Returns 0 on failure, and 1 on success.
+ * freepool: Stop and join the worker threads of the pool of (exp).
+ */
+void parallel(struct exp *exp, void (*job)(struct exp *exp, int from, int to));
+void everyworker(struct exp *exp, void (*job)(struct exp *exp, int worker, int nworkers));
+int mkpool(struct exp *exp);
+void freepool(struct exp *exp);
+
+/* forces: Calculate the electric and gravitational force on every object in the particles of (exp), using the
+ * routine set in (exp), and add the time taken to the tally of the compiler in its stats. (forces) will return 0
+ * on failure, and 1 on success.
+ * accuracy: Compare the forces of the routine set in (exp) against those of the direct routine, for the first
+ * frame of (exp), and print a report of the relative error and time taken by each to stdout; for the fmm
+ * routine, the error and time of every order are also reported. In a periodic box, the direct routine sums over
+ * the nearest image of every object, and the ewald and pm routines are compared against the ewald routine split by
+ * EW_REFERENCE.
+ */
+int forces(struct exp *exp);
+void accuracy(struct exp *exp);
+
+/* Routines calculate the forces on the objects from (from) up to, but not including, (to).
+ *
+ * direct: Calculate forces on objects by summing over every other object; the charges and masses of the others
+ * are summed with one root and one quotient per pair, and the constants and the object's own charge and mass
+ * applied once, after.
+ * barneshut: Calculate forces on objects by summing over cells of the quadtree built by (mktree); a cell of
+ * width (s) at a distance (d) is summed as a whole when s / d < (theta), or opened otherwise.
+ * mktree: Build the quadtree over the particles of (exp). Returns 0 on failure, and 1 on success.
+ * freetree: Free the tree structure (tree).
+ * symmetric: Calculate forces on every object by summing over every pair of objects once, applying equal and
+ * opposite pulls to both; the pairs are split between the workers of the pool, each summing into its own pull
+ * structure, which are added together at the end. Returns 0 on failure, and 1 on success.
+ * cutoff: Calculate forces on objects by summing over their neighbours within (cutoff) alone, from the lists built
+ * by (mklists); in a periodic box, over the nearest image of each.
+ * cutoffcells: As (cutoff), but for the objects from (from) up to (to) in the order of the lists of the grid, so
+ * that objects near each other are summed together, over neighbours that are still in the cache.
+ * mklists: Build the neighbour lists of (exp) again if an object has moved far enough since they were last built,
+ * or for the first time, and copy the objects into them in the order of the grid; to be called before (cutoff) or
+ * (cutoffcells) every time. Returns 0 on failure, and 1 on success.
+ * freelists: Free the lists structure (lists).
+ * ewald: Calculate forces on every object from every image of every object in the periodic box, by Ewald's sums;
+ * each force is split into one that falls off as erfc(alpha r), summed over the neighbours within (cutoff) from
+ * the lists built by (mklists), and the rest, summed over waves. The waves are made again whenever the split,
+ * (cutoff) or (box) change. Returns 0 on failure, and 1 on success.
+ * ewaldcutoff: Return the cutoff for which the ewald routine takes the least time over the system of (exp), as
+ * the time of a wave at an object is about EW_COST of that of a neighbour, within half of the box with the skin.
+ * freeewald: Free the ewald structure (ewald).
+ * pm: Calculate forces on every object by spreading the charges and masses over the points of a mesh, each over the
+ * three points nearest it either way with the weights of a triangular-shaped cloud, summing the force at every
+ * point as a convolution by fast Fourier transforms, and interpolating the forces back with the same weights; the
+ * mesh is that of the periodic box, or twice the square of the objects in open space, and has (mesh) cells along
+ * each side of it, or as many as are chosen if (mesh) is 0. With a (cutoff), only the part of each force that falls
+ * off as erf(alpha r) is left to the mesh, and the rest is summed over the neighbours within it, from the lists
+ * built by (mklists), as particle-particle particle-mesh does. The transforms and the interpolation are split
+ * between the workers of the pool. Returns 0 on failure, and 1 on success.
+ * freepm: Free the pm structure (pm).
+ * fastmultipole: Calculate forces on every object from the multipole expansions of the boxes of a uniform
+ * quadtree, translated into local expansions about the boxes they are well-separated from, and by summing over
+ * the objects of neighbouring leaves; the expansions are of the potential 1 / r, as Cartesian Taylor series in the
+ * plane (or in space) to (order), so that an (order) of 1 holds the dipoles, as the cells of (barneshut) do. Each
+ * pass over a level of the tree is split between the workers of the pool. Returns 0 on failure, and 1 on success.
+ * freefmm: Free the fmm structure (fmm).
+ * directsimd: Calculate forces as (direct) does, but for many pairs at once with the vector instructions named
+ * by (simd); only available with PRECISION=double or PRECISION=float on x86-64.
+ * simd: Return the name of the vector instructions that (directsimd) uses on this CPU, or NULL if there are none
+ * it can use, in which case (direct) must be used instead.
+ */
+void direct(struct exp *exp, int from, int to);
+void directsimd(struct exp *exp, int from, int to);
+const char *simd(void);
+void barneshut(struct exp *exp, int from, int to);
+int mktree(struct exp *exp);
+int symmetric(struct exp *exp);
+void freetree(struct tree *tree);
+void cutoff(struct exp *exp, int from, int to);
+void cutoffcells(struct exp *exp, int from, int to);
+int mklists(struct exp *exp);
+void freelists(struct lists *lists);
+int ewald(struct exp *exp);
+real ewaldcutoff(struct exp *exp);
+void freeewald(struct ewald *ewald);
+int pm(struct exp *exp);
+void freepm(struct pm *pm);
+int fastmultipole(struct exp *exp);
+void freefmm(struct fmm *fmm);
+
+/* compiler: Compile frames for an experiment structure; each frame is (stride) steps after the last, and only
+ * the fields that are rendered are stored.
+ * renderer: Render frames compiled by the compiler, then hand their slots back to it.
  */
 void *compiler(void *);
 void *renderer(void *);
+
+/* runexp: Run the compiler and renderer over (exp), which must have been initialized by (initexp), until its
+ * limit is reached; and the writer of checkpoints, if they are taken. The stats of the run are then summarized.
+ * (runexp) will return 0 on failure, and 1 on success.
+ */
+int runexp(struct exp *exp);
+
+/* runbatch: Run every experiment file in the directory (path), or listed in the file (path) one on each line, on
+ * (nworkers) threads at once; each with its own experiment structure, with the output options and jobs of
+ * (options), and rendered to a file beside it, "name.out" for "name.exp", or "name.bin" if binary. (runbatch)
+ * will return the number of experiments that failed, or -1 if none could be run.
+ */
+int runbatch(const char *path, int nworkers, const struct exp *options);
+
+/* runsweep: Run every run of the sweep of (exp), which must have been initialized by (initexp), on (nworkers)
+ * threads at once; each rendered to a file beside the experiment file, "name.1.out" up to "name.(nruns).out" for
+ * "name.exp", numbered as wide as (nruns), or ".bin" if binary; with the values of every run listed in "name.runs". The runs share the system
+ * of (exp), and each worker keeps the memory of its runs from one to the next. (runsweep) will return the number
+ * of runs that failed, or -1 if none could be run.
+ * freesweep: Free the list of sweeps (sweep).
+ */
+int runsweep(struct exp *exp, int nworkers);
+void freesweep(struct sweep *sweep);
+
+/* mapsystem: Map the system file at (path) into memory as the source of the objects of (exp), and count them.
+ * Returns 0 on failure, and 1 on success.
+ * loadsystem: Read the objects of the source of (exp) into its particles, which must have been allocated, and
+ * unmap it. Returns 0 on failure, and 1 on success.
+ * unmapsystem: Unmap the source (source), if it is mapped.
+ */
+int mapsystem(const char *path, struct exp *exp);
+int loadsystem(struct exp *exp);
+void unmapsystem(struct source *source);
+
+/* readcheckpoint: Read the checkpoint at (path) into the experiment structure (exp), in place of (readexp); every
+ * option and object is as it was, and the experiment begins at the frame of the checkpoint. Returns 0 on failure,
+ * and 1 on success.
+ * resume: Restore the rest of the state read by (readcheckpoint) into the particles of (exp), once it has been
+ * initialized by (initexp), so that it goes on exactly as it would have.
+ * mkwriter: Start the writer of checkpoints of (exp), if they are taken. Returns 0 on failure, and 1 on success.
+ * freewriter: Stop and join the writer of (exp), once the checkpoint it is writing is in place.
+ * checkpoint: Take a checkpoint of (exp) at frame (n), before it is compiled, if one is due and the writer is
+ * idle; otherwise, it is taken at the next frame that the writer is idle.
+ * rendered: Tell the writer of (exp) that frames before (next) have been rendered, flushing them to the output if
+ * a checkpoint is waiting on them.
+ */
+int readcheckpoint(const char *path, struct exp *exp);
+void resume(struct exp *exp);
+int mkwriter(struct exp *exp);
+void freewriter(struct exp *exp);
+void checkpoint(struct exp *exp, int n);
+void rendered(struct exp *exp, int next);
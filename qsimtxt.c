@@ -0,0 +1,138 @@
+/* qsimtxt: Convert the binary output of qsim to its text output.
+ *
+ * qsimtxt [binary-file]
+ *
+ * The binary output is read from (binary-file), or from stdin if it is not given, and the text is written to
+ * stdout; only the fields that were written to the binary output are printed. Returns 1 if the input could not be
+ * read, or ends within a frame, whose frames before it are still printed.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include "qsim.h"
+
+/* getreal: Return the real of size (realsize) at (p) as a long double; or 0 if the size is not known. */
+static long double getreal(const unsigned char *p, int realsize)
+{
+	float f;
+	double d;
+	long double ld = 0;
+
+	if (realsize == sizeof(float))
+		return memcpy(&f, p, sizeof(float)), f;
+
+	if (realsize == sizeof(double))
+		return memcpy(&d, p, sizeof(double)), d;
+
+	if (realsize == sizeof(long double)
+	 || (realsize == 10 && LDBL_MANT_DIG == 64))
+		return memcpy(&ld, p, realsize), ld;
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[F_COUNT] = { F_NAMES };
+	FILE *f = stdin;
+	struct header header;
+	unsigned char *record, *p;
+	size_t size, got;
+	int n, i, k, d, nfields = 0, r = EXIT_SUCCESS;
+
+	if (argc > 1 && (f = fopen(argv[1], "rb")) == NULL)
+	{
+		fprintf(stderr, "(fail) qsimtxt: Could not open \"%s\".\n", argv[1]);
+
+		return EXIT_FAILURE;
+	}
+
+	if (fread(&header, sizeof(struct header), 1, f) != 1
+	 || memcmp(header.magic, B_MAGIC, sizeof(B_MAGIC)) != 0)
+	{
+		fprintf(stderr, "(fail) qsimtxt: Input is not binary output of qsim.\n");
+
+		return EXIT_FAILURE;
+	}
+
+	if (header.version != B_VERSION)
+	{
+		fprintf(stderr, "(fail) qsimtxt: Input is of version %d; only version %d is known.\n", header.version, B_VERSION);
+
+		return EXIT_FAILURE;
+	}
+
+	if (header.realsize != sizeof(float) && header.realsize != sizeof(double)
+	 && header.realsize != sizeof(long double) && !(header.realsize == 10 && LDBL_MANT_DIG == 64))
+	{
+		fprintf(stderr, "(fail) qsimtxt: Reals of %d bytes are not supported on this machine.\n", header.realsize);
+
+		return EXIT_FAILURE;
+	}
+
+	if (header.dimensions != 2 && header.dimensions != 3)
+	{
+		fprintf(stderr, "(fail) qsimtxt: Input is of %d dimensions; only 2 or 3 are known.\n", header.dimensions);
+
+		return EXIT_FAILURE;
+	}
+
+	for (k = 0; k < F_COUNT; ++k)
+		nfields += (header.fields >> k) & 1;
+
+	size = sizeof(int) + (size_t)header.nobjects * nfields * header.dimensions * header.realsize;
+
+	if ((record = malloc(size)) == NULL)
+	{
+		fprintf(stderr, "(crash) qsimtxt: malloc returned NULL.\n");
+
+		return EXIT_FAILURE;
+	}
+
+	while ((got = fread(record, 1, size, f)) == size)
+	{
+		memcpy(&n, record, sizeof(int));
+		p = record + sizeof(int);
+
+		printf("frame %d:\n", n);
+
+		for (i = 0; i < header.nobjects; ++i)
+		{
+			printf("\t" "object %d:\n", i);
+
+			for (k = 0; k < F_COUNT; ++k)
+				if (header.fields & (1 << k))
+				{
+					printf("\t\t" "%s: (%Le", names[k], getreal(p, header.realsize));
+
+					for (d = 1; d < header.dimensions; ++d)
+						printf(", %Le", getreal(p + d * header.realsize, header.realsize));
+
+					printf(")\n");
+					p += header.dimensions * header.realsize;
+				}
+		}
+	}
+
+	if (ferror(f))
+	{
+		fprintf(stderr, "(fail) qsimtxt: Could not read the input.\n");
+		r = EXIT_FAILURE;
+	} else
+	if (got != 0)
+	/* the input ends within a frame, as that of a run that stopped, or a file cut short */
+	{
+		fprintf(stderr, "(fail) qsimtxt: Input ends %lu bytes into a frame of %lu bytes; the frames before it were converted.\n",
+		    (unsigned long)got, (unsigned long)size);
+		r = EXIT_FAILURE;
+	}
+
+	free(record);
+	fclose(f);
+
+	return r;
+}
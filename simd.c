@@ -0,0 +1,191 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "qsim.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && (defined(PRECISION_double) || defined(PRECISION_float))
+
+#include <immintrin.h>
+
+/* Vector operations of each instruction set, for the real type; S_ for AVX2, Z_ for AVX-512. */
+#if defined(PRECISION_double)
+#define S_vec          __m256d
+#define S_WIDTH        4
+#define S_set1         _mm256_set1_pd
+#define S_zero         _mm256_setzero_pd
+#define S_load         _mm256_loadu_pd
+#define S_store        _mm256_storeu_pd
+#define S_add          _mm256_add_pd
+#define S_sub          _mm256_sub_pd
+#define S_mul          _mm256_mul_pd
+#define S_div          _mm256_div_pd
+#define S_sqrt         _mm256_sqrt_pd
+
+#define Z_vec          __m512d
+#define Z_WIDTH        8
+#define Z_set1         _mm512_set1_pd
+#define Z_zero         _mm512_setzero_pd
+#define Z_load         _mm512_loadu_pd
+#define Z_store        _mm512_storeu_pd
+#define Z_add          _mm512_add_pd
+#define Z_sub          _mm512_sub_pd
+#define Z_mul          _mm512_mul_pd
+#define Z_div          _mm512_div_pd
+#define Z_sqrt         _mm512_sqrt_pd
+#else
+#define S_vec          __m256
+#define S_WIDTH        8
+#define S_set1         _mm256_set1_ps
+#define S_zero         _mm256_setzero_ps
+#define S_load         _mm256_loadu_ps
+#define S_store        _mm256_storeu_ps
+#define S_add          _mm256_add_ps
+#define S_sub          _mm256_sub_ps
+#define S_mul          _mm256_mul_ps
+#define S_div          _mm256_div_ps
+#define S_sqrt         _mm256_sqrt_ps
+
+#define Z_vec          __m512
+#define Z_WIDTH        16
+#define Z_set1         _mm512_set1_ps
+#define Z_zero         _mm512_setzero_ps
+#define Z_load         _mm512_loadu_ps
+#define Z_store        _mm512_storeu_ps
+#define Z_add          _mm512_add_ps
+#define Z_sub          _mm512_sub_ps
+#define Z_mul          _mm512_mul_ps
+#define Z_div          _mm512_div_ps
+#define Z_sqrt         _mm512_sqrt_ps
+#endif
+
+/* SIMD_kernel: Define the function (_name), calculating forces as (direct) does, with the vector operations
+ * prefixed by (_p) for the instruction set (_target). For each object (i), the objects before and after it are
+ * summed (_p##WIDTH) at a time, and the remainder of each one at a time; the pull sums are as in (barneshut), those
+ * of charge and then of mass, each of DIM components.
+ */
+#define SIMD_kernel(_name, _target, _p)                                                                 \
+__attribute__((target(_target)))                                                                        \
+static void _name(struct exp *exp, int from, int to)                                                    \
+{                                                                                                       \
+	struct particles *P = &exp->particles;                                                          \
+	real e2 = exp->softening * exp->softening;                                                       \
+	_p##vec xi, yi, D3(zi,) dx, dy, D3(dz,) w, one = _p##set1((real)1), eps = _p##set1(e2);         \
+	_p##vec qx, qy, D3(qz,) mx, my D3(, mz);                                                        \
+	real lanes[2 * DIM][_p##WIDTH], sum[2 * DIM], rx, ry, D3(rz,) rsquared, wr;                     \
+	int i, j, k, pass, begin, end, n = exp->nobjects;                                                \
+                                                                                                        \
+	for (i = from; i < to; ++i)                                                                      \
+	{                                                                                                \
+		xi = _p##set1(P->x[i]);                                                                  \
+		yi = _p##set1(P->y[i]);                                                                  \
+		D3(zi = _p##set1(P->z[i]);)                                                             \
+		qx = qy = D3(qz =) mx = my = D3(mz =) _p##zero();                                       \
+                                                                                                        \
+		for (k = 0; k < 2 * DIM; ++k)                                                           \
+			sum[k] = (real)0;                                                               \
+                                                                                                        \
+		for (pass = 0; pass < 2; ++pass)                                                         \
+		{                                                                                        \
+			begin = pass == 0 ? 0 : i + 1;                                                   \
+			end = pass == 0 ? i : n;                                                         \
+                                                                                                        \
+			for (j = begin; j + _p##WIDTH <= end; j += _p##WIDTH)                            \
+			{                                                                                \
+				dx = _p##sub(_p##load(&P->x[j]), xi);                                    \
+				dy = _p##sub(_p##load(&P->y[j]), yi);                                    \
+				D3(dz = _p##sub(_p##load(&P->z[j]), zi);)                               \
+				w = _p##add(_p##mul(dx, dx), _p##mul(dy, dy));                          \
+				D3(w = _p##add(w, _p##mul(dz, dz));)                                    \
+				w = _p##add(w, eps);                                                    \
+				/* w: 1 / r^3, softened */                                               \
+				w = _p##div(one, _p##mul(w, _p##sqrt(w)));                               \
+                                                                                                        \
+				qx = _p##add(qx, _p##mul(dx, _p##mul(w, _p##load(&P->charge[j]))));     \
+				qy = _p##add(qy, _p##mul(dy, _p##mul(w, _p##load(&P->charge[j]))));     \
+				D3(qz = _p##add(qz, _p##mul(dz, _p##mul(w, _p##load(&P->charge[j]))));) \
+				mx = _p##add(mx, _p##mul(dx, _p##mul(w, _p##load(&P->mass[j]))));       \
+				my = _p##add(my, _p##mul(dy, _p##mul(w, _p##load(&P->mass[j]))));       \
+				D3(mz = _p##add(mz, _p##mul(dz, _p##mul(w, _p##load(&P->mass[j]))));)   \
+			}                                                                                \
+                                                                                                        \
+			for (; j < end; ++j)                                                             \
+			{                                                                                \
+				rx = P->x[j] - P->x[i];                                                  \
+				ry = P->y[j] - P->y[i];                                                  \
+				D3(rz = P->z[j] - P->z[i];)                                             \
+				rsquared = rx * rx + ry * ry D3(+ rz * rz) + e2;                        \
+				wr = (real)1 / (rsquared * sqrtr(rsquared));                             \
+                                                                                                        \
+				sum[0] += rx * P->charge[j] * wr;                                        \
+				sum[1] += ry * P->charge[j] * wr;                                        \
+				D3(sum[2] += rz * P->charge[j] * wr;)                                   \
+				sum[DIM] += rx * P->mass[j] * wr;                                       \
+				sum[DIM + 1] += ry * P->mass[j] * wr;                                   \
+				D3(sum[5] += rz * P->mass[j] * wr;)                                     \
+			}                                                                                \
+		}                                                                                        \
+                                                                                                        \
+		_p##store(lanes[0], qx);                                                                 \
+		_p##store(lanes[1], qy);                                                                 \
+		D3(_p##store(lanes[2], qz);)                                                            \
+		_p##store(lanes[DIM], mx);                                                              \
+		_p##store(lanes[DIM + 1], my);                                                          \
+		D3(_p##store(lanes[5], mz);)                                                            \
+                                                                                                        \
+		for (k = 0; k < _p##WIDTH; ++k)                                                          \
+			sum[0] += lanes[0][k], sum[1] += lanes[1][k],                                    \
+			sum[DIM] += lanes[DIM][k], sum[DIM + 1] += lanes[DIM + 1][k]                    \
+			D3(, sum[2] += lanes[2][k], sum[5] += lanes[5][k]);                             \
+                                                                                                        \
+		P->fex[i] = sum[0] * -K * P->charge[i], P->fey[i] = sum[1] * -K * P->charge[i];          \
+		P->fgx[i] = sum[DIM] * G * P->mass[i], P->fgy[i] = sum[DIM + 1] * G * P->mass[i];       \
+		D3(P->fez[i] = sum[2] * -K * P->charge[i], P->fgz[i] = sum[5] * G * P->mass[i];)        \
+	}                                                                                                \
+}
+
+SIMD_kernel(directavx2, "avx2", S_)
+SIMD_kernel(directavx512, "avx512f", Z_)
+
+static void (*kernel)(struct exp *, int, int);
+static const char *name;
+static pthread_once_t chosen = PTHREAD_ONCE_INIT;
+
+/* choose: Choose the kernel for this CPU; once, as experiments may be run at once in a batch. */
+static void choose(void)
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f"))
+		kernel = directavx512, name = "avx512";
+	else
+	if (__builtin_cpu_supports("avx2"))
+		kernel = directavx2, name = "avx2";
+}
+
+const char *simd(void)
+{
+	pthread_once(&chosen, choose);
+
+	return name;
+}
+
+void directsimd(struct exp *exp, int from, int to)
+{
+	kernel(exp, from, to);
+}
+
+#else
+
+const char *simd(void)
+{
+	return NULL;
+}
+
+void directsimd(struct exp *exp, int from, int to)
+{
+	direct(exp, from, to);
+}
+
+#endif
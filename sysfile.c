@@ -0,0 +1,222 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "qsim.h"
+
+/* longest last line of a text system file that does not end in a new-line */
+#define SF_LINESIZE  1024
+
+/* blank: Return if the line at (p), ending at (end), holds no object. */
+static int blank(const char *p, const char *end)
+{
+	while (p < end && isspace((unsigned char)*p))
+		++p;
+
+	return p == end || *p == '#';
+}
+
+/* parse: Read the numbers of the object on the line at (p) into (x); the line must be followed by a character that
+ * is not part of a number, at (end). Returns 0 if they are not there, and 1 on success.
+ */
+static int parse(const char *p, const char *end, long double *x)
+{
+	char *next;
+	int k;
+
+	for (k = 0; k < SF_COLUMNS; ++k)
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+			++p;
+
+		/* (strtold) skips new-lines too, which would take the number from the next line */
+		if (p == end || isspace((unsigned char)*p))
+			return 0;
+
+		x[k] = strtold(p, &next);
+
+		if (next == p || next > end)
+			return 0;
+
+		for (p = next; p < end && (*p == ' ' || *p == '\t'); ++p)
+			;
+
+		if (k < SF_COLUMNS - 1 && (p == end || *p++ != ','))
+			return 0;
+	}
+
+	return blank(p, end);
+}
+
+int mapsystem(const char *path, struct exp *exp)
+{
+	struct source *source = &exp->source;
+	struct sysheader header;
+	struct stat statbuf;
+	const char *p, *end, *line;
+	void *map;
+	long n;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &statbuf) == -1 || !S_ISREG(statbuf.st_mode))
+	{
+		warn(WL_fail, "mapsystem", "Could not open system file \"%a\".\n", path);
+
+		if (fd != -1)
+			close(fd);
+
+		return 0;
+	}
+
+	if (statbuf.st_size == 0)
+	{
+		warn(WL_fail, "mapsystem", "System file \"%a\" is empty.\n", path);
+		close(fd);
+
+		return 0;
+	}
+
+	map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+	{
+		warn(WL_fail, "mapsystem", "Could not map system file \"%a\" into memory.\n", path);
+
+		return 0;
+	}
+
+	/* the file is read through once, in order */
+	madvise(map, statbuf.st_size, MADV_SEQUENTIAL);
+
+	strcpy(source->path, path);
+	source->map = map;
+	source->size = statbuf.st_size;
+	source->binary = source->size >= sizeof(SF_MAGIC) && memcmp(map, SF_MAGIC, sizeof(SF_MAGIC)) == 0;
+
+	if (source->binary)
+	{
+		memcpy(&header, map, sizeof(struct sysheader));
+		n = header.nobjects;
+
+		if (header.version != SF_VERSION || n < 1
+		 || source->size != sizeof(struct sysheader) + (size_t)n * SF_COLUMNS * sizeof(double))
+		{
+			warn(WL_fail, "mapsystem", "System file \"%a\" is not of version %i, or its size is not that of its objects.\n",
+			    path, SF_VERSION);
+			unmapsystem(source);
+
+			return 0;
+		}
+	} else {
+		/* count the lines that hold objects */
+		for (n = 0, p = source->map, end = p + source->size; p < end; p = line + 1)
+		{
+			if ((line = memchr(p, '\n', end - p)) == NULL)
+				line = end;
+
+			n += !blank(p, line);
+		}
+
+		if (n < 1 || n > 0x7fffffff)
+		{
+			warn(WL_fail, "mapsystem", "System file \"%a\" holds no objects, or too many.\n", path);
+			unmapsystem(source);
+
+			return 0;
+		}
+	}
+
+	exp->nobjects = (int)n;
+
+	return 1;
+}
+
+int loadsystem(struct exp *exp)
+{
+	struct source *source = &exp->source;
+	struct particles *P = &exp->particles;
+	real *arrays[SF_COLUMNS] = { P->x, P->y, D3(P->z,) P->vx, P->vy, D3(P->vz,) P->charge, P->mass };
+	const double *column;
+	const char *p, *end, *line;
+	char buf[SF_LINESIZE];
+	long double x[SF_COLUMNS];
+	int i, k, n = exp->nobjects, number;
+
+	if (source->binary)
+	{
+		/* the header is as long as a double, or two, so the columns are aligned */
+		column = (const double *)(source->map + sizeof(struct sysheader));
+
+		for (k = 0; k < SF_COLUMNS; ++k, column += n)
+			for (i = 0; i < n; ++i)
+				arrays[k][i] = column[i];
+
+		unmapsystem(source);
+
+		return 1;
+	}
+
+	for (i = 0, number = 1, p = source->map, end = p + source->size; p < end; p = line + 1, ++number)
+	{
+		if ((line = memchr(p, '\n', end - p)) == NULL)
+		/* the last line, without a new-line after it; (strtold) must not read past the end of the file */
+		{
+			if (end - p >= SF_LINESIZE)
+			{
+				warn(WL_fail, "loadsystem", "Line %i of system file \"%a\" is too long.\n", number, source->path);
+				unmapsystem(source);
+
+				return 0;
+			}
+
+			memcpy(buf, p, end - p);
+			buf[end - p] = '\0';
+			line = end;
+
+			if (blank(buf, buf + (end - p)))
+				continue;
+
+			if (!parse(buf, buf + (end - p), x))
+				goto loadsystem_fail;
+		} else {
+			if (blank(p, line))
+				continue;
+
+			if (!parse(p, line, x))
+				goto loadsystem_fail;
+		}
+
+		for (k = 0; k < SF_COLUMNS; ++k)
+			arrays[k][i] = x[k];
+
+		++i;
+	}
+
+	unmapsystem(source);
+
+	return 1;
+
+loadsystem_fail:
+
+	warn(WL_fail, "loadsystem", "Line %i of system file \"%a\" is not %i numbers separated by commas.\n",
+	    number, source->path, SF_COLUMNS);
+	unmapsystem(source);
+
+	return 0;
+}
+
+void unmapsystem(struct source *source)
+{
+	if (source->map == NULL)
+		return;
+
+	munmap((void *)source->map, source->size);
+	source->map = NULL;
+}